@@ -0,0 +1,249 @@
+#include "auth.h"
+
+#include <arpa/inet.h>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <map>
+#include <stdexcept>
+
+namespace generals {
+
+namespace {
+
+// Returns the nanoseconds elapsed since the provided time.
+inline uint64_t NanosSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+// Appends a uint32_t to the buffer in network byte order.
+inline void AppendU32(std::string& buf, uint32_t v) {
+  v = htonl(v);
+  buf.append(reinterpret_cast<const char*>(&v), sizeof(v));
+}
+
+// Returns the digest a message's signatures cover for its value: the digest of
+// the value, the digest of the value it was relayed without, or all zeros if it
+// never had one. Returns nothing if the message carries a malformed digest.
+std::experimental::optional<crypto::Digest> ValueDigest(
+    const msg::Message& msg) {
+  crypto::Digest digest{};
+  if (msg.value) {
+    if (!msg.value_digest.empty()) return {};
+    return crypto::Hash(*msg.value);
+  }
+  if (msg.value_digest.empty()) return digest;
+  if (msg.value_digest.size() != digest.size()) return {};
+  std::copy(msg.value_digest.begin(), msg.value_digest.end(), digest.begin());
+  return digest;
+}
+
+// Returns the data the signature of hop ids[hop] covers: the instance, the path
+// up to the hop and the digest of the value.
+std::string SignedData(const msg::Message& msg, size_t hop,
+                       const crypto::Digest& value_digest,
+                       unsigned int instance) {
+  std::string buf;
+  buf.reserve(sizeof(uint32_t) * (hop + 3) + value_digest.size());
+  AppendU32(buf, instance);
+  AppendU32(buf, hop + 1);
+  for (size_t i = 0; i <= hop; ++i) {
+    AppendU32(buf, msg.ids[i]);
+  }
+  buf.append(reinterpret_cast<const char*>(value_digest.data()),
+             value_digest.size());
+  return buf;
+}
+
+}  // namespace
+
+KeySet ReadKeyFile(const std::string& path) {
+  std::ifstream file(path);
+  if (!file) {
+    throw std::runtime_error("could not open key file");
+  }
+
+  std::vector<crypto::Key> lines;
+  std::string line;
+  while (file >> line) {
+    auto key = crypto::KeyFromString(line);
+    if (!key) {
+      throw std::runtime_error("invalid key in key file");
+    }
+    lines.push_back(*key);
+  }
+
+  // A shared key and a public key per process, and our seed.
+  if (lines.size() % 2 != 1) {
+    throw std::runtime_error("invalid number of keys in key file");
+  }
+  size_t process_num = lines.size() / 2;
+  KeySet keys;
+  keys.shared.assign(lines.begin(), lines.begin() + process_num);
+  keys.signing = lines[process_num];
+  keys.verifying.assign(lines.begin() + process_num + 1, lines.end());
+  return keys;
+}
+
+void GenerateKeyFiles(const std::string& dir, size_t process_num) {
+  // The key process i shares with process j is shared[i][j] == shared[j][i].
+  // A process shares no key with itself.
+  std::vector<std::vector<crypto::Key>> shared(
+      process_num, std::vector<crypto::Key>(process_num, crypto::Key{}));
+  for (size_t i = 0; i < process_num; ++i) {
+    for (size_t j = i + 1; j < process_num; ++j) {
+      shared[i][j] = shared[j][i] = crypto::RandomKey();
+    }
+  }
+  std::vector<crypto::SigningKey> seeds;
+  std::vector<crypto::VerifyingKey> public_keys;
+  for (size_t i = 0; i < process_num; ++i) {
+    seeds.push_back(crypto::RandomKey());
+    public_keys.push_back(crypto::Ed25519Signer(seeds.back()).PublicKey());
+  }
+
+  for (size_t i = 0; i < process_num; ++i) {
+    std::ofstream file(dir + "/keys." + std::to_string(i));
+    for (auto const& key : shared[i]) {
+      file << crypto::KeyString(key) << "\n";
+    }
+    file << crypto::KeyString(seeds[i]) << "\n";
+    for (auto const& key : public_keys) {
+      file << crypto::KeyString(key) << "\n";
+    }
+    if (!file) {
+      throw std::runtime_error("could not write key file");
+    }
+  }
+}
+
+std::ostream& operator<<(std::ostream& o, const AuthStats& s) {
+  o << "signed " << s.signed_msgs << " messages in " << s.sign_nanos / 1000
+    << "us, verified " << s.verified_msgs << " messages (" << s.verified_sigs
+    << " signatures, " << s.cached_sigs << " already checked) in "
+    << s.verify_nanos / 1000 << "us";
+  if (s.verify_nanos > 0) {
+    o << " (" << s.verified_sigs * 1000000000 / s.verify_nanos
+      << " signatures/s)";
+  }
+  return o;
+}
+
+MessageAuth::MessageAuth(unsigned int id, const crypto::SigningKey& signing,
+                         const std::vector<crypto::VerifyingKey>& keys)
+    : id_(id),
+      signer_(signing),
+      keys_(keys),
+      signed_msgs_(0),
+      sign_nanos_(0),
+      verified_msgs_(0),
+      verified_sigs_(0),
+      cached_sigs_(0),
+      verify_nanos_(0) {}
+
+void MessageAuth::Sign(msg::Message& msg, unsigned int instance) const {
+  auto start = std::chrono::steady_clock::now();
+  if (msg.ids.empty() || msg.ids.back() != id_) {
+    throw std::logic_error("signing a message that does not end with our id");
+  }
+
+  auto digest = ValueDigest(msg);
+  if (!digest) {
+    throw std::logic_error("signing a message with a malformed value digest");
+  }
+
+  auto data = SignedData(msg, msg.ids.size() - 1, *digest, instance);
+  auto sig = signer_.Sign(data.data(), data.size());
+  msg.auth.emplace_back(reinterpret_cast<const char*>(sig.data()), sig.size());
+
+  signed_msgs_++;
+  sign_nanos_ += NanosSince(start);
+}
+
+void MessageAuth::SignOutbox(Outbox& outbox, unsigned int instance) const {
+  std::map<std::vector<unsigned int>, std::vector<std::string>> signed_auth;
+  for (auto& batch : outbox) {
+    for (auto& msg : batch.second) {
+      auto it = signed_auth.find(msg.ids);
+      if (it != signed_auth.end()) {
+        msg.auth = it->second;
+        continue;
+      }
+      Sign(msg, instance);
+      signed_auth.emplace(msg.ids, msg.auth);
+    }
+  }
+}
+
+bool MessageAuth::Verify(const msg::Message& msg,
+                         unsigned int instance) const {
+  auto start = std::chrono::steady_clock::now();
+
+  // Every hop must have signed the message.
+  auto digest = ValueDigest(msg);
+  if (msg.ids.empty() || msg.auth.size() != msg.ids.size() || !digest) {
+    return false;
+  }
+
+  bool valid = true;
+  for (size_t hop = 0; hop < msg.ids.size() && valid; ++hop) {
+    unsigned int signer = msg.ids[hop];
+    const std::string& signature = msg.auth[hop];
+    crypto::Signature sig;
+    if (signer >= keys_.size() || signature.size() != sig.size()) {
+      valid = false;
+      break;
+    }
+
+    // The data and the signature together identify a valid signature.
+    auto entry = SignedData(msg, hop, *digest, instance) + signature;
+    {
+      std::lock_guard<std::mutex> lock(verified_mu_);
+      if (verified_.count(entry) > 0) {
+        cached_sigs_++;
+        continue;
+      }
+      auto before = verified_before_.find(entry);
+      if (before != verified_before_.end()) {
+        verified_.insert(*before);
+        verified_before_.erase(before);
+        cached_sigs_++;
+        continue;
+      }
+    }
+    std::copy(signature.begin(), signature.end(), sig.begin());
+    size_t data_size = entry.size() - signature.size();
+    valid = crypto::Ed25519Verify(keys_[signer], entry.data(), data_size, sig);
+    verified_sigs_++;
+    if (valid) {
+      std::lock_guard<std::mutex> lock(verified_mu_);
+      verified_.insert(std::move(entry));
+    }
+  }
+
+  verified_msgs_++;
+  verify_nanos_ += NanosSince(start);
+  return valid;
+}
+
+void MessageAuth::EndRound() const {
+  std::lock_guard<std::mutex> lock(verified_mu_);
+  verified_before_ = std::move(verified_);
+  verified_.clear();
+}
+
+AuthStats MessageAuth::TakeStats() const {
+  AuthStats s;
+  s.signed_msgs = signed_msgs_.exchange(0);
+  s.sign_nanos = sign_nanos_.exchange(0);
+  s.verified_msgs = verified_msgs_.exchange(0);
+  s.verified_sigs = verified_sigs_.exchange(0);
+  s.cached_sigs = cached_sigs_.exchange(0);
+  s.verify_nanos = verify_nanos_.exchange(0);
+  return s;
+}
+
+}  // namespace generals
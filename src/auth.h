@@ -0,0 +1,127 @@
+#ifndef AUTH_H_
+#define AUTH_H_
+
+#include <atomic>
+#include <cstdint>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "ed25519.h"
+#include "hmac.h"
+#include "message.h"
+#include "protocol.h"
+
+namespace generals {
+
+// The keys of a process.
+struct KeySet {
+  // The key shared with each process, indexed by process ID, which
+  // authenticates the datagrams between them (see udp::LinkAuth).
+  std::vector<crypto::Key> shared;
+  // The seed this process signs messages with.
+  crypto::SigningKey signing;
+  // The public key of each process, indexed by process ID.
+  std::vector<crypto::VerifyingKey> verifying;
+};
+
+// Reads the keys of a process from the file at the provided path (see
+// GenerateKeyFiles). Throws an exception if the file can not be read.
+KeySet ReadKeyFile(const std::string& path);
+
+// Generates a fresh key for every pair of process_num processes and a fresh
+// key pair for every process, and writes the keys of each process i to the
+// file "keys.<i>" in the provided directory. Each file holds one hexadecimal
+// key per line: the key shared with each process j on line j, then the seed of
+// process i, then the public key of each process j. It only holds the secret
+// keys of one process, so that it can be distributed to that process alone.
+// Throws an exception if a file can not be written.
+void GenerateKeyFiles(const std::string& dir, size_t process_num);
+
+// Counts the authentication work done by a MessageAuth, to measure the cost of
+// cryptography per round.
+struct AuthStats {
+  uint64_t signed_msgs;
+  uint64_t sign_nanos;
+  uint64_t verified_msgs;
+  // Signatures checked, and those found among the ones already checked.
+  uint64_t verified_sigs;
+  uint64_t cached_sigs;
+  uint64_t verify_nanos;
+};
+
+// Allow streaming of AuthStats on ostreams.
+std::ostream& operator<<(std::ostream& o, const AuthStats& s);
+
+// Authenticates the chain of processes that relayed a message, one hop at a
+// time. To sign a message, the last process in its path appends its Ed25519
+// signature over the agreement instance, the path up to and including itself,
+// and the digest of the value. A receiver checks the signature of every hop
+// with the public key of its signer, so that a faulty process can neither
+// forge nor alter the value or path that another process vouched for. Since
+// every receiver checks the same signatures, a message that is authentic for
+// one loyal process is authentic for all of them, and a loyal process can
+// relay what a faulty one signed as proof of what it sent.
+//
+// A process that relays a message without its value, because it already
+// relayed that value (see SignedMessages), keeps the signatures of the previous
+// hops and the digest of the value they cover (see DropValue), so that every
+// hop of every message is signed and checked. A message that never had a value
+// is signed with a digest of all zeros.
+//
+// The same hop prefixes recur across many messages of a round, like the
+// signature of the Commander in every message, so each valid signature is only
+// checked once. A message relays the hops of a message of the round before, so
+// valid signatures are remembered for the round they were last used in and the
+// next one, which bounds the memory they take to two rounds of them.
+class MessageAuth {
+ public:
+  // Creates the authentication state of process id given the seed it signs
+  // with and the public key of every process, indexed by process ID.
+  MessageAuth(unsigned int id, const crypto::SigningKey& signing,
+              const std::vector<crypto::VerifyingKey>& keys);
+
+  // Appends the signature of this process to the message, which must end with
+  // our id and carry the signatures of every previous hop, in the provided
+  // agreement instance.
+  void Sign(msg::Message& msg, unsigned int instance) const;
+
+  // Signs every message in the outbox. Messages with the same path in an
+  // outbox are copies of the same message, so each one is only signed once.
+  void SignOutbox(Outbox& outbox, unsigned int instance) const;
+
+  // Verifies the signatures of every hop of the message in the provided
+  // agreement instance. Safe to call from any thread.
+  bool Verify(const msg::Message& msg, unsigned int instance) const;
+
+  // Forgets the valid signatures not used in the round that just ended. Safe
+  // to call from any thread.
+  void EndRound() const;
+
+  // Returns the work done since the last call and resets the counters.
+  AuthStats TakeStats() const;
+
+ private:
+  const unsigned int id_;
+  const crypto::Ed25519Signer signer_;
+  const std::vector<crypto::VerifyingKey> keys_;
+
+  // The signed data and signature of every hop found valid this round, and
+  // those of the round before that have not been used again yet.
+  mutable std::mutex verified_mu_;
+  mutable std::unordered_set<std::string> verified_;
+  mutable std::unordered_set<std::string> verified_before_;
+
+  mutable std::atomic<uint64_t> signed_msgs_;
+  mutable std::atomic<uint64_t> sign_nanos_;
+  mutable std::atomic<uint64_t> verified_msgs_;
+  mutable std::atomic<uint64_t> verified_sigs_;
+  mutable std::atomic<uint64_t> cached_sigs_;
+  mutable std::atomic<uint64_t> verify_nanos_;
+};
+
+}  // namespace generals
+
+#endif
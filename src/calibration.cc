@@ -0,0 +1,233 @@
+#include "calibration.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <stdexcept>
+#include <thread>
+
+#include "log.h"
+#include "message.h"
+#include "thread.h"
+
+namespace generals {
+
+namespace {
+
+using std::chrono::microseconds;
+using std::chrono::steady_clock;
+
+// Encodes a Ping of the provided type.
+msg::Ping EncodePing(uint32_t type, unsigned int seq, unsigned int sender) {
+  msg::Ping ping = {};
+  ping.type = htonl(type);
+  ping.size = htonl(sizeof(ping));
+  ping.seq = htonl(seq);
+  ping.sender = htonl(sender);
+  return ping;
+}
+
+// Decodes a Ping of the provided type from the buffer and returns its sequence
+// number. If the decoding is successful, the optional return value will be
+// present. If not, the return value will be absent.
+std::experimental::optional<unsigned int> SeqOfPing(uint32_t type, char* buf,
+                                                    size_t n) {
+  if (n != sizeof(msg::Ping)) {
+    return {};
+  }
+  msg::Ping* ping = reinterpret_cast<msg::Ping*>(buf);
+  if (ntohl(ping->type) != type) {
+    return {};
+  }
+  return ntohl(ping->seq);
+}
+
+// Pings the client once and returns the round trip time, or an absent value if
+// no answer came back in time.
+std::experimental::optional<microseconds> PingOnce(udp::ClientPtr client,
+                                                   unsigned int id,
+                                                   unsigned int seq) {
+  auto ping = EncodePing(kPingType, seq, id);
+  auto isPong = [seq](udp::ClientPtr _, char* buf, size_t n) {
+    auto pong = SeqOfPing(kPongType, buf, n);
+    if (!pong || *pong != seq) return udp::ServerAction::Continue;
+    return udp::ServerAction::Stop;
+  };
+
+  auto sent = steady_clock::now();
+  if (!client->SendWithAck(reinterpret_cast<char*>(&ping), sizeof(ping), 1,
+                           isPong)) {
+    return {};
+  }
+  return std::chrono::duration_cast<microseconds>(steady_clock::now() - sent);
+}
+
+// Pings the client until it first answers, within kCalibrationStartWindow, and
+// then the provided number of times.
+PeerStats ProbePeer(udp::ClientPtr client, unsigned int id,
+                    unsigned int pings) {
+  PeerStats stats;
+  unsigned int seq = 0;
+  auto start = steady_clock::now();
+  while (steady_clock::now() - start < kCalibrationStartWindow) {
+    if (PingOnce(client, id, seq++)) {
+      stats.reachable = true;
+      break;
+    }
+    std::this_thread::sleep_for(kCalibrationPingInterval);
+  }
+  if (!stats.reachable) {
+    return stats;
+  }
+
+  for (unsigned int i = 0; i < pings; ++i) {
+    std::this_thread::sleep_for(kCalibrationPingInterval);
+    auto rtt = PingOnce(client, id, seq++);
+    stats.sent++;
+    if (rtt) {
+      stats.rtts.push_back(*rtt);
+    } else {
+      stats.lost++;
+    }
+  }
+  std::sort(stats.rtts.begin(), stats.rtts.end());
+  return stats;
+}
+
+}  // namespace
+
+microseconds PeerStats::Percentile(unsigned int p) const {
+  if (rtts.empty()) {
+    return kCalibrationProbeTimeout;
+  }
+  size_t rank = (rtts.size() * p + 99) / 100;
+  return rtts[std::max<size_t>(rank, 1) - 1];
+}
+
+double PeerStats::LossRate() const {
+  return (lost + 1.0) / (sent + 2.0);
+}
+
+std::ostream& operator<<(std::ostream& o, const PeerStats& s) {
+  if (!s.reachable) {
+    return o << "{unreachable}";
+  }
+  o << "{sent: " << s.sent << ", lost: " << s.lost;
+  if (!s.rtts.empty()) {
+    o << ", rtt_p50: " << s.Percentile(50).count()
+      << "us, rtt_p99: " << s.Percentile(99).count()
+      << "us, rtt_max: " << s.rtts.back().count() << "us";
+  }
+  return o << "}";
+}
+
+Calibration DeriveTimeouts(std::vector<PeerStats> peers,
+                           const CalibrationOptions& options) {
+  // Rank the reachable processes from the best link to the worst, and ignore
+  // the faulty number of worst ones, as long as one is left.
+  std::vector<const PeerStats*> ranked;
+  for (auto const& peer : peers) {
+    if (peer.reachable) ranked.push_back(&peer);
+  }
+  if (ranked.empty()) {
+    throw std::runtime_error("calibration could not reach any process");
+  }
+  std::sort(ranked.begin(), ranked.end(),
+            [](const PeerStats* a, const PeerStats* b) {
+              return std::make_pair(a->Percentile(99), a->LossRate()) <
+                     std::make_pair(b->Percentile(99), b->LossRate());
+            });
+  size_t keep = std::max<size_t>(
+      1, ranked.size() - std::min<size_t>(options.faulty, ranked.size()));
+  ranked.resize(keep);
+
+  microseconds p50{0};
+  microseconds p99{0};
+  double loss = 0;
+  for (auto const* peer : ranked) {
+    p50 = std::max(p50, peer->Percentile(50));
+    p99 = std::max(p99, peer->Percentile(99));
+    loss = std::max(loss, peer->LossRate());
+  }
+
+  Calibration c;
+  c.ack.timeout = std::min<microseconds>(
+      std::max<microseconds>(2 * p99, kMinCalibratedAckTimeout),
+      kCalibrationProbeTimeout);
+
+  // Each attempt is lost with probability loss, so all k attempts are with
+  // probability loss^k.
+  c.ack.attempts = 1;
+  while (std::pow(loss, c.ack.attempts) > 1 - options.target_success &&
+         c.ack.attempts < kMaxCalibratedAttempts) {
+    c.ack.attempts++;
+  }
+
+  size_t messages = std::max<size_t>(options.messages_per_round, 1);
+  c.round_timeout = (messages - 1) * p50 + c.ack.attempts * c.ack.timeout;
+  c.peers = std::move(peers);
+  return c;
+}
+
+Calibration Calibrate(const ProcessList& processes, unsigned int id,
+                      unsigned short port, udp::LinkAuthPtr link_auth,
+                      const CalibrationOptions& options) {
+  LOG(INFO) << "Calibrating with " << options.pings
+            << " pings to every process\n";
+  udp::Server server(port, link_auth);
+  auto clients =
+      ClientsForProcessList(processes, link_auth, kCalibrationProbeTimeout);
+
+  // Ping every other process from its own thread.
+  std::vector<PeerStats> peers(processes.size());
+  std::atomic<size_t> probing{processes.size() - 1};
+  threadutil::ThreadGroup probers;
+  for (unsigned int pid = 0; pid < processes.size(); ++pid) {
+    if (pid == id) continue;
+    auto client = clients.at(processes[pid]);
+    probers.AddThread([&peers, &probing, &options, client, id, pid] {
+      peers[pid] = ProbePeer(client, id, options.pings);
+      probing--;
+    });
+  }
+
+  // Answer the pings of the other processes until we are done pinging, and
+  // nobody pinged us for a while.
+  auto last_ping = steady_clock::now();
+  server.SetDeadline(last_ping + kCalibrationPingInterval);
+  server.Listen(
+      [id, &last_ping](udp::ClientPtr client, char* buf, size_t n) {
+        if (!client->Authentic()) {
+          return udp::ServerAction::Continue;
+        }
+        auto seq = SeqOfPing(kPingType, buf, n);
+        if (seq) {
+          last_ping = steady_clock::now();
+          auto pong = EncodePing(kPongType, *seq, id);
+          client->Send(reinterpret_cast<char*>(&pong), sizeof(pong));
+        }
+        return udp::ServerAction::Continue;
+      },
+      [&server, &probing, &last_ping]() {
+        auto now = steady_clock::now();
+        if (probing == 0 && now - last_ping >= kCalibrationLinger) {
+          return udp::ServerAction::Stop;
+        }
+        server.SetDeadline(now + kCalibrationPingInterval);
+        return udp::ServerAction::Continue;
+      });
+  probers.JoinAll();
+
+  for (unsigned int pid = 0; pid < peers.size(); ++pid) {
+    if (pid == id) continue;
+    LOG(DEBUG) << "Calibration of p" << pid << ": " << peers[pid] << "\n";
+  }
+  auto c = DeriveTimeouts(std::move(peers), options);
+  LOG(INFO) << "Calibrated an ack timeout of " << c.ack.timeout.count()
+            << "us with " << c.ack.attempts << " attempts, and a round "
+            << "timeout of " << c.round_timeout.count() << "us, for a "
+            << "success probability of " << options.target_success << "\n";
+  return c;
+}
+
+}  // namespace generals
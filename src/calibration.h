@@ -0,0 +1,105 @@
+#ifndef CALIBRATION_H_
+#define CALIBRATION_H_
+
+#include <chrono>
+#include <iostream>
+#include <vector>
+
+#include "general.h"
+#include "udp_conn.h"
+
+namespace generals {
+
+// The default number of pings sent to each process while calibrating.
+const unsigned int kDefaultCalibrationPings = 20;
+// The default probability that a datagram is acknowledged before its sender
+// gives up on it, which calibrated timeouts aim for.
+const double kDefaultTargetSuccess = 0.999999;
+// The time between two pings to the same process.
+const auto kCalibrationPingInterval = std::chrono::milliseconds{5};
+// The longest a ping waits for its answer, which also bounds the calibrated
+// ack timeout. Slower answers count as lost.
+const auto kCalibrationProbeTimeout = kAckTimeout;
+// How long a process keeps pinging a process that does not answer yet, because
+// it may not have started.
+const auto kCalibrationStartWindow = std::chrono::seconds{10};
+// How long a process that is done pinging keeps answering the pings of others
+// after the last one it received. Longer than the time between two pings from a
+// process that is still pinging, even if the first one is lost.
+const auto kCalibrationLinger = 2 * kCalibrationProbeTimeout;
+// The bounds of the calibrated ack timeout and number of attempts.
+const auto kMinCalibratedAckTimeout = std::chrono::milliseconds{1};
+const unsigned int kMaxCalibratedAttempts = 10;
+
+// Configures a calibration.
+struct CalibrationOptions {
+  // The number of pings to send to each process.
+  unsigned int pings;
+  // The probability that a datagram is acknowledged before its sender gives up
+  // on it, in (0, 1).
+  double target_success;
+  // The number of faulty processes, whose measurements are ignored.
+  unsigned int faulty;
+  // The most messages a process sends to a single process in a round.
+  size_t messages_per_round;
+};
+
+// The measurements of the round trip times to a single process.
+struct PeerStats {
+  // Whether the process answered any ping. The other fields are only
+  // meaningful if it did.
+  bool reachable = false;
+  // The number of pings sent and lost once the process first answered.
+  unsigned int sent = 0;
+  unsigned int lost = 0;
+  // The round trip times of the pings that were answered, in increasing order.
+  std::vector<std::chrono::microseconds> rtts;
+
+  // Returns the round trip time at the provided percentile, in (0, 100].
+  std::chrono::microseconds Percentile(unsigned int p) const;
+  // Returns a conservative estimate of the probability of losing a ping, with
+  // Laplace's rule of succession so that no loss is never taken as certain.
+  double LossRate() const;
+};
+
+// Allow streaming of PeerStats on ostreams.
+std::ostream& operator<<(std::ostream& o, const PeerStats& s);
+
+// The timeouts chosen by a calibration, and the measurements behind them.
+struct Calibration {
+  AckPolicy ack;
+  // The longest a round should take, used as the upper bound of the round
+  // deadline.
+  std::chrono::microseconds round_timeout;
+  // The measurements of each process, indexed by process ID.
+  std::vector<PeerStats> peers;
+};
+
+// Derives the timeouts from the measurements of each process. Ignores the
+// faulty processes with the slowest or lossiest links, since a faulty process
+// could answer slowly on purpose, and must not dictate the timeouts of every
+// other process. The ack timeout is twice the 99th percentile round trip time,
+// and the number of attempts is the smallest that gets a datagram through with
+// the target probability given the loss rate. A round must leave time for the
+// messages to one process to go out one after the other, the last one needing
+// every attempt. Throws an exception if no process was reachable.
+Calibration DeriveTimeouts(std::vector<PeerStats> peers,
+                           const CalibrationOptions& options);
+
+// Measures the network at startup, before running the algorithm, and picks
+// timeouts that fit it instead of the lab defaults. Every process must
+// calibrate at about the same time: process id pings every other process,
+// while answering their pings on the port of its server, until every process
+// has been measured. Logs the measurements and the chosen timeouts.
+//
+// The other processes may still be calibrating for a while after this returns,
+// since they linger as long as any process pings them, during which they do not
+// handle other datagrams. The Commander waits for them to be ready before
+// round 0 (see WaitForReady).
+Calibration Calibrate(const ProcessList& processes, unsigned int id,
+                      unsigned short port, udp::LinkAuthPtr link_auth,
+                      const CalibrationOptions& options);
+
+}  // namespace generals
+
+#endif
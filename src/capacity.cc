@@ -0,0 +1,110 @@
+#include "capacity.h"
+
+#include <algorithm>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+
+#include "message.h"
+
+namespace generals {
+
+std::ostream& operator<<(std::ostream& o, const RoundLoad& l) {
+  return o << "{messages_sent: " << l.messages_sent
+           << ", messages_received: " << l.messages_received
+           << ", bytes_sent: " << l.bytes_sent
+           << ", bytes_received: " << l.bytes_received
+           << ", acks_sent: " << l.acks_sent
+           << ", acks_received: " << l.acks_received
+           << ", sender_threads: " << l.sender_threads
+           << ", memory_bytes: " << l.memory_bytes
+           << ", duration: " << l.duration.count() << "us}";
+}
+
+namespace {
+
+// Returns the time it takes to send the provided number of messages one after
+// the other, each waiting a round trip for its acknowledgement, and at least a
+// round trip. Throws std::overflow_error if it does not fit.
+std::chrono::microseconds SerialDuration(std::chrono::microseconds rtt,
+                                         size_t messages) {
+  size_t us = CheckedMul(rtt.count(), std::max<size_t>(messages, 1));
+  if (us > static_cast<size_t>(
+               std::numeric_limits<std::chrono::microseconds::rep>::max())) {
+    throw std::overflow_error("duration overflows");
+  }
+  return std::chrono::microseconds(us);
+}
+
+}  // namespace
+
+std::vector<RoundCapacity> PlanCapacity(const RoundPlan& plan,
+                                        const CapacityOptions& options) {
+  const size_t lieutenants = plan.Processes() - 1;
+  const size_t ack_bytes = sizeof(msg::Ack);
+
+  std::vector<RoundCapacity> rounds;
+  for (unsigned int r = 0; r <= plan.LastRound(); ++r) {
+    RoundCapacity c;
+    c.round = r;
+
+    // The Commander sends its value to every Lieutenant at once in round 0.
+    if (r == 0) {
+      RoundLoad& cmdr = c.commander;
+      cmdr.messages_sent = lieutenants;
+      cmdr.acks_received = lieutenants;
+      cmdr.bytes_sent = CheckedMul(lieutenants, plan.MaxMessageBytes(0));
+      cmdr.bytes_received = CheckedMul(lieutenants, ack_bytes);
+      cmdr.sender_threads = lieutenants;
+      cmdr.memory_bytes = CheckedMul(
+          lieutenants, CheckedAdd(plan.MaxMessageBytes(0), kMessageOverhead));
+      cmdr.duration = SerialDuration(options.rtt, 1);
+    }
+
+    // A Lieutenant receives the messages of the round, and sends those it
+    // received in the round before to the processes not in their path.
+    RoundLoad& lt = c.lieutenant;
+    size_t sent = r == 0 ? 0 : CheckedMul(plan.Messages(r - 1), plan.Fanout(r));
+    lt.messages_sent = sent;
+    lt.messages_received = plan.Messages(r);
+    lt.acks_sent = lt.messages_received;
+    lt.acks_received = sent;
+    lt.bytes_sent =
+        CheckedAdd(plan.SendBytes(r), CheckedMul(lt.acks_sent, ack_bytes));
+    lt.bytes_received =
+        CheckedAdd(plan.ReceiveBytes(r), CheckedMul(sent, ack_bytes));
+    lt.sender_threads = r == 0 ? 0 : lieutenants - 1;
+
+    size_t held = CheckedMul(
+        lt.messages_received,
+        CheckedAdd(plan.MaxMessageBytes(r), kMessageOverhead));
+    if (r < plan.LastRound()) {
+      size_t relayed = CheckedMul(plan.Messages(r), plan.Fanout(r + 1));
+      held = CheckedAdd(
+          held, CheckedMul(relayed, CheckedAdd(plan.MaxMessageBytes(r + 1),
+                                               kMessageOverhead)));
+    }
+    lt.memory_bytes = held;
+    lt.duration = SerialDuration(options.rtt, plan.MessagesPerDestination(r));
+
+    rounds.push_back(c);
+  }
+  return rounds;
+}
+
+void CheckCapacity(const std::vector<RoundCapacity>& rounds,
+                   const CapacityOptions& options) {
+  for (auto const& c : rounds) {
+    // Lieutenants wait for the Commander in round 0 as long as it takes.
+    if (c.round == 0) continue;
+    if (c.lieutenant.duration > options.round_timeout) {
+      std::ostringstream err;
+      err << "round " << c.round << " needs about "
+          << c.lieutenant.duration.count() << "us, more than the round "
+          << "timeout of " << options.round_timeout.count() << "us";
+      throw std::invalid_argument(err.str());
+    }
+  }
+}
+
+}  // namespace generals
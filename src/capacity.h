@@ -0,0 +1,70 @@
+#ifndef CAPACITY_H_
+#define CAPACITY_H_
+
+#include <chrono>
+#include <cstddef>
+#include <iostream>
+#include <vector>
+
+#include "round_plan.h"
+
+namespace generals {
+
+// The round trip time assumed by default when planning capacity.
+const auto kDefaultPlanRtt = std::chrono::microseconds{200};
+// The memory assumed for each message held in a set or an outbox, on top of its
+// encoding, for the node and the bookkeeping around it.
+const size_t kMessageOverhead = 128;
+
+// The assumptions behind a capacity estimate.
+struct CapacityOptions {
+  // The round trip time between any two processes.
+  std::chrono::microseconds rtt;
+  // The longest a round may take (see RoundDeadline).
+  std::chrono::microseconds round_timeout;
+};
+
+// What a single process does in a round, according to a capacity estimate.
+struct RoundLoad {
+  size_t messages_sent = 0;
+  size_t messages_received = 0;
+  // Bytes of messages and acknowledgements.
+  size_t bytes_sent = 0;
+  size_t bytes_received = 0;
+  size_t acks_sent = 0;
+  size_t acks_received = 0;
+  size_t sender_threads = 0;
+  // The memory held by the messages received in the round and those to relay
+  // in the next one.
+  size_t memory_bytes = 0;
+  // How long it takes to send the messages of the round, one after the other
+  // to each process, each waiting a round trip for its acknowledgement.
+  std::chrono::microseconds duration{0};
+};
+
+// Allow streaming of RoundLoad on ostreams.
+std::ostream& operator<<(std::ostream& o, const RoundLoad& l);
+
+// The load of the Commander and of each Lieutenant in a round. The Commander
+// only takes part in round 0.
+struct RoundCapacity {
+  unsigned int round;
+  RoundLoad commander;
+  RoundLoad lieutenant;
+};
+
+// Estimates the load of every round of the plan, with overflow-checked
+// arithmetic (see RoundPlan). Throws std::overflow_error if a count does not
+// fit in a size_t.
+std::vector<RoundCapacity> PlanCapacity(const RoundPlan& plan,
+                                        const CapacityOptions& options);
+
+// Throws std::invalid_argument if a Lieutenant round is estimated to take
+// longer than the round timeout, in which case the algorithm can not finish
+// with the assumed round trip time.
+void CheckCapacity(const std::vector<RoundCapacity>& rounds,
+                   const CapacityOptions& options);
+
+}  // namespace generals
+
+#endif
@@ -0,0 +1,43 @@
+#include "deadline.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
+namespace generals {
+
+RoundDeadline::RoundDeadline(std::chrono::microseconds min,
+                             std::chrono::microseconds max)
+    : min_(min), max_(max), current_(max) {
+  if (min.count() <= 0 || min > max) {
+    throw std::invalid_argument("round deadline bounds must be 0 < min <= max");
+  }
+}
+
+void RoundDeadline::Record(std::chrono::microseconds last_arrival) {
+  samples_.push_back(last_arrival);
+  if (samples_.size() > kDeadlineWindow) {
+    samples_.pop_front();
+  }
+
+  std::vector<std::chrono::microseconds> sorted(samples_.begin(),
+                                                samples_.end());
+  size_t rank = (sorted.size() * kDeadlinePercentile + 99) / 100;
+  auto nth = sorted.begin() + (rank - 1);
+  std::nth_element(sorted.begin(), nth, sorted.end());
+
+  auto margin = std::max<std::chrono::microseconds>(*nth, kDeadlineMargin);
+  current_ = Clamp(*nth + margin);
+}
+
+void RoundDeadline::Backoff() {
+  samples_.clear();
+  current_ = Clamp(current_ * 2);
+}
+
+std::chrono::microseconds RoundDeadline::Clamp(
+    std::chrono::microseconds d) const {
+  return std::min(std::max(d, min_), max_);
+}
+
+}  // namespace generals
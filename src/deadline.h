@@ -0,0 +1,54 @@
+#ifndef DEADLINE_H_
+#define DEADLINE_H_
+
+#include <chrono>
+#include <cstddef>
+#include <deque>
+
+namespace generals {
+
+// The number of recent rounds a RoundDeadline learns from.
+const size_t kDeadlineWindow = 32;
+// The percentile of recent arrival times a RoundDeadline waits for.
+const unsigned int kDeadlinePercentile = 95;
+// The smallest safety margin a RoundDeadline adds to the percentile.
+const auto kDeadlineMargin = std::chrono::milliseconds{5};
+
+// Computes round deadlines from observed latency instead of waiting a fixed
+// time for messages that may never come. After every round, the time at which
+// its last message arrived, counted from the start of the round, is recorded.
+// The deadline is a high percentile of the recent arrival times plus a safety
+// margin of at least that much again, clamped to the configured bounds. A
+// round that completes early never waits for its deadline, so the arrival time
+// measures the latency of the slowest loyal peer, even in rounds that time out
+// waiting for a crashed one.
+//
+// A message that arrives after its round has ended means the deadline was too
+// short for some peer, so the deadline is doubled and the samples that led to
+// it are forgotten. Until the first sample, the deadline is the upper bound.
+class RoundDeadline {
+ public:
+  RoundDeadline(std::chrono::microseconds min, std::chrono::microseconds max);
+
+  // Returns the deadline for the next round.
+  inline std::chrono::microseconds Current() const { return current_; }
+
+  // Records that the last message of a round arrived after the provided time
+  // since the start of the round.
+  void Record(std::chrono::microseconds last_arrival);
+  // Records that a message arrived after the end of its round.
+  void Backoff();
+
+ private:
+  const std::chrono::microseconds min_;
+  const std::chrono::microseconds max_;
+  std::deque<std::chrono::microseconds> samples_;
+  std::chrono::microseconds current_;
+
+  // Returns the duration clamped to the bounds.
+  std::chrono::microseconds Clamp(std::chrono::microseconds d) const;
+};
+
+}  // namespace generals
+
+#endif
@@ -0,0 +1,428 @@
+#include "ed25519.h"
+
+#include <string.h>
+
+#include "sha512.h"
+
+namespace crypto {
+
+namespace {
+
+typedef unsigned __int128 uint128_t;
+
+const uint64_t kMask51 = (uint64_t{1} << 51) - 1;
+
+// An element of the field of integers modulo p = 2^255 - 19, in five limbs of
+// 51 bits each. Limbs may exceed 51 bits by a few bits between operations.
+struct Fe {
+  uint64_t v[5];
+};
+
+// Propagates the carries between the limbs, folding the carry out of the top
+// limb back into the bottom one times 19, since 2^255 = 19 modulo p.
+inline void Carry(Fe& h) {
+  for (int i = 0; i < 4; ++i) {
+    h.v[i + 1] += h.v[i] >> 51;
+    h.v[i] &= kMask51;
+  }
+  h.v[0] += 19 * (h.v[4] >> 51);
+  h.v[4] &= kMask51;
+}
+
+inline Fe FromInt(uint64_t n) { return Fe{{n, 0, 0, 0, 0}}; }
+
+inline Fe Add(const Fe& a, const Fe& b) {
+  Fe h;
+  for (int i = 0; i < 5; ++i) h.v[i] = a.v[i] + b.v[i];
+  Carry(h);
+  return h;
+}
+
+inline Fe Sub(const Fe& a, const Fe& b) {
+  // Add 4p first, so that no limb underflows.
+  Fe h;
+  h.v[0] = a.v[0] + 0x1FFFFFFFFFFFB4 - b.v[0];
+  for (int i = 1; i < 5; ++i) h.v[i] = a.v[i] + 0x1FFFFFFFFFFFFC - b.v[i];
+  Carry(h);
+  return h;
+}
+
+inline Fe Neg(const Fe& a) { return Sub(FromInt(0), a); }
+
+Fe Mul(const Fe& a, const Fe& b) {
+  // Products past the top limb wrap around times 19.
+  uint64_t b1 = 19 * b.v[1], b2 = 19 * b.v[2], b3 = 19 * b.v[3],
+           b4 = 19 * b.v[4];
+  uint128_t r0 = (uint128_t)a.v[0] * b.v[0] + (uint128_t)a.v[1] * b4 +
+                 (uint128_t)a.v[2] * b3 + (uint128_t)a.v[3] * b2 +
+                 (uint128_t)a.v[4] * b1;
+  uint128_t r1 = (uint128_t)a.v[0] * b.v[1] + (uint128_t)a.v[1] * b.v[0] +
+                 (uint128_t)a.v[2] * b4 + (uint128_t)a.v[3] * b3 +
+                 (uint128_t)a.v[4] * b2;
+  uint128_t r2 = (uint128_t)a.v[0] * b.v[2] + (uint128_t)a.v[1] * b.v[1] +
+                 (uint128_t)a.v[2] * b.v[0] + (uint128_t)a.v[3] * b4 +
+                 (uint128_t)a.v[4] * b3;
+  uint128_t r3 = (uint128_t)a.v[0] * b.v[3] + (uint128_t)a.v[1] * b.v[2] +
+                 (uint128_t)a.v[2] * b.v[1] + (uint128_t)a.v[3] * b.v[0] +
+                 (uint128_t)a.v[4] * b4;
+  uint128_t r4 = (uint128_t)a.v[0] * b.v[4] + (uint128_t)a.v[1] * b.v[3] +
+                 (uint128_t)a.v[2] * b.v[2] + (uint128_t)a.v[3] * b.v[1] +
+                 (uint128_t)a.v[4] * b.v[0];
+
+  Fe h;
+  r1 += static_cast<uint64_t>(r0 >> 51);
+  h.v[0] = static_cast<uint64_t>(r0) & kMask51;
+  r2 += static_cast<uint64_t>(r1 >> 51);
+  h.v[1] = static_cast<uint64_t>(r1) & kMask51;
+  r3 += static_cast<uint64_t>(r2 >> 51);
+  h.v[2] = static_cast<uint64_t>(r2) & kMask51;
+  r4 += static_cast<uint64_t>(r3 >> 51);
+  h.v[3] = static_cast<uint64_t>(r3) & kMask51;
+  h.v[4] = static_cast<uint64_t>(r4) & kMask51;
+  h.v[0] += 19 * static_cast<uint64_t>(r4 >> 51);
+  h.v[1] += h.v[0] >> 51;
+  h.v[0] &= kMask51;
+  return h;
+}
+
+inline Fe Sq(const Fe& a) { return Mul(a, a); }
+
+// Returns a squared n times.
+Fe SqN(Fe a, int n) {
+  for (int i = 0; i < n; ++i) a = Sq(a);
+  return a;
+}
+
+inline uint64_t Load64(const uint8_t* s) {
+  uint64_t v = 0;
+  for (int i = 7; i >= 0; --i) v = v << 8 | s[i];
+  return v;
+}
+
+// Decodes the 255 low bits of the 32 bytes, little-endian.
+Fe FromBytes(const uint8_t* s) {
+  Fe h;
+  h.v[0] = Load64(s) & kMask51;
+  h.v[1] = (Load64(s + 6) >> 3) & kMask51;
+  h.v[2] = (Load64(s + 12) >> 6) & kMask51;
+  h.v[3] = (Load64(s + 19) >> 1) & kMask51;
+  h.v[4] = (Load64(s + 24) >> 12) & kMask51;
+  return h;
+}
+
+// Encodes the canonical representative of h in 32 bytes, little-endian.
+void ToBytes(uint8_t* s, Fe h) {
+  // Once carried, h is below 2p, so subtracting p once if h + 19 carries out
+  // of bit 255 leaves the canonical representative.
+  Carry(h);
+  uint64_t q = (h.v[0] + 19) >> 51;
+  for (int i = 1; i < 5; ++i) q = (h.v[i] + q) >> 51;
+  h.v[0] += 19 * q;
+  for (int i = 0; i < 4; ++i) {
+    h.v[i + 1] += h.v[i] >> 51;
+    h.v[i] &= kMask51;
+  }
+  h.v[4] &= kMask51;
+
+  uint64_t w[4] = {h.v[0] | h.v[1] << 51, h.v[1] >> 13 | h.v[2] << 38,
+                   h.v[2] >> 26 | h.v[3] << 25, h.v[3] >> 39 | h.v[4] << 12};
+  for (int i = 0; i < 4; ++i) {
+    for (int j = 0; j < 8; ++j) {
+      s[8 * i + j] = static_cast<uint8_t>(w[i] >> 8 * j);
+    }
+  }
+}
+
+bool Equal(const Fe& a, const Fe& b) {
+  uint8_t sa[32], sb[32];
+  ToBytes(sa, a);
+  ToBytes(sb, b);
+  return memcmp(sa, sb, sizeof(sa)) == 0;
+}
+
+bool IsZero(const Fe& a) { return Equal(a, FromInt(0)); }
+
+// Determines if the canonical representative of a is odd, which Ed25519 takes
+// as the sign of a coordinate.
+bool IsNegative(const Fe& a) {
+  uint8_t s[32];
+  ToBytes(s, a);
+  return s[0] & 1;
+}
+
+// Returns z^(2^250 - 1), the common part of Invert and Pow22523, and z^11.
+Fe Pow2250(const Fe& z, Fe& z11) {
+  Fe z2 = Sq(z);
+  Fe z9 = Mul(SqN(z2, 2), z);
+  z11 = Mul(z9, z2);
+  Fe z2_5_0 = Mul(Sq(z11), z9);
+  Fe z2_10_0 = Mul(SqN(z2_5_0, 5), z2_5_0);
+  Fe z2_20_0 = Mul(SqN(z2_10_0, 10), z2_10_0);
+  Fe z2_40_0 = Mul(SqN(z2_20_0, 20), z2_20_0);
+  Fe z2_50_0 = Mul(SqN(z2_40_0, 10), z2_10_0);
+  Fe z2_100_0 = Mul(SqN(z2_50_0, 50), z2_50_0);
+  Fe z2_200_0 = Mul(SqN(z2_100_0, 100), z2_100_0);
+  return Mul(SqN(z2_200_0, 50), z2_50_0);
+}
+
+// Returns 1/z, as z^(p - 2) = z^(2^255 - 21).
+Fe Invert(const Fe& z) {
+  Fe z11;
+  Fe t = Pow2250(z, z11);
+  return Mul(SqN(t, 5), z11);
+}
+
+// Returns z^((p - 5) / 8) = z^(2^252 - 3), for square roots.
+Fe Pow22523(const Fe& z) {
+  Fe z11;
+  Fe t = Pow2250(z, z11);
+  return Mul(SqN(t, 2), z);
+}
+
+// The constants of the curve -x^2 + y^2 = 1 + d x^2 y^2: d = -121665/121666,
+// 2d, and a square root of -1, which is 2^((p - 1) / 4) since 2 is not a
+// square.
+const Fe kD = Mul(Neg(FromInt(121665)), Invert(FromInt(121666)));
+const Fe kD2 = Add(kD, kD);
+const Fe kSqrtM1 = Mul(Sq(Pow22523(FromInt(2))), FromInt(2));
+
+// A point of the curve in extended coordinates: x = X/Z, y = Y/Z, xy = T/Z.
+struct Point {
+  Fe x, y, z, t;
+};
+
+inline Point Identity() {
+  return Point{FromInt(0), FromInt(1), FromInt(1), FromInt(0)};
+}
+
+// Adds two points with a formula that is complete on this curve, so it also
+// doubles and handles the identity (Hisil et al., "add-2008-hwcd-3").
+Point AddPoints(const Point& p, const Point& q) {
+  Fe a = Mul(Sub(p.y, p.x), Sub(q.y, q.x));
+  Fe b = Mul(Add(p.y, p.x), Add(q.y, q.x));
+  Fe c = Mul(Mul(p.t, q.t), kD2);
+  Fe d = Mul(p.z, q.z);
+  d = Add(d, d);
+  Fe e = Sub(b, a);
+  Fe f = Sub(d, c);
+  Fe g = Add(d, c);
+  Fe h = Add(b, a);
+  return Point{Mul(e, f), Mul(g, h), Mul(f, g), Mul(e, h)};
+}
+
+inline Point NegPoint(const Point& p) {
+  return Point{Neg(p.x), p.y, p.z, Neg(p.t)};
+}
+
+// Replaces r with s if bit is 1, without branching on bit.
+inline void Select(Point& r, const Point& s, uint64_t bit) {
+  uint64_t mask = 0 - bit;
+  Fe* rf[4] = {&r.x, &r.y, &r.z, &r.t};
+  const Fe* sf[4] = {&s.x, &s.y, &s.z, &s.t};
+  for (int i = 0; i < 4; ++i) {
+    for (int j = 0; j < 5; ++j) {
+      rf[i]->v[j] ^= mask & (rf[i]->v[j] ^ sf[i]->v[j]);
+    }
+  }
+}
+
+// Returns [scalar]p for the 32 byte little-endian scalar, doubling and adding
+// at every bit, so that the time taken does not depend on the scalar.
+Point ScalarMult(const Point& p, const uint8_t* scalar) {
+  Point r = Identity();
+  for (int i = 255; i >= 0; --i) {
+    r = AddPoints(r, r);
+    Point s = AddPoints(r, p);
+    Select(r, s, (scalar[i / 8] >> (i % 8)) & 1);
+  }
+  return r;
+}
+
+// Returns [a]p + [b]q for the 32 byte little-endian scalars, sharing the
+// doublings between both. Only for public scalars, since it adds a point only
+// where a scalar has a bit set.
+Point DoubleScalarMultVartime(const Point& p, const uint8_t* a, const Point& q,
+                              const uint8_t* b) {
+  Point pq = AddPoints(p, q);
+  Point r = Identity();
+  for (int i = 255; i >= 0; --i) {
+    r = AddPoints(r, r);
+    bool bit_a = (a[i / 8] >> (i % 8)) & 1;
+    bool bit_b = (b[i / 8] >> (i % 8)) & 1;
+    if (bit_a && bit_b) {
+      r = AddPoints(r, pq);
+    } else if (bit_a) {
+      r = AddPoints(r, p);
+    } else if (bit_b) {
+      r = AddPoints(r, q);
+    }
+  }
+  return r;
+}
+
+void Encode(uint8_t* s, const Point& p) {
+  Fe zi = Invert(p.z);
+  ToBytes(s, Mul(p.y, zi));
+  s[31] |= IsNegative(Mul(p.x, zi)) << 7;
+}
+
+// Decodes an encoded point (RFC 8032, section 5.1.3). Returns whether the
+// encoding is canonical and the point is on the curve.
+bool Decode(const uint8_t* s, Point& p) {
+  Fe y = FromBytes(s);
+  uint8_t canonical[32];
+  ToBytes(canonical, y);
+  canonical[31] |= s[31] & 0x80;
+  if (memcmp(canonical, s, sizeof(canonical)) != 0) {
+    return false;
+  }
+
+  // x^2 = u / v, so x = u v^3 (u v^7)^((p - 5) / 8) if it exists.
+  Fe one = FromInt(1);
+  Fe y2 = Sq(y);
+  Fe u = Sub(y2, one);
+  Fe v = Add(Mul(y2, kD), one);
+  Fe v3 = Mul(Sq(v), v);
+  Fe x = Mul(Mul(u, v3), Pow22523(Mul(u, Mul(Sq(v3), v))));
+  Fe vx2 = Mul(v, Sq(x));
+  if (!Equal(vx2, u)) {
+    if (!Equal(vx2, Neg(u))) {
+      return false;
+    }
+    x = Mul(x, kSqrtM1);
+  }
+
+  bool negative = s[31] >> 7;
+  if (negative && IsZero(x)) {
+    return false;
+  }
+  if (IsNegative(x) != negative) {
+    x = Neg(x);
+  }
+  p = Point{x, y, one, Mul(x, y)};
+  return true;
+}
+
+// The base point, whose y is 4/5 and x is positive.
+const uint8_t kBaseBytes[32] = {
+    0x58, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66,
+    0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66,
+    0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66,
+};
+
+Point BasePoint() {
+  Point b;
+  Decode(kBaseBytes, b);
+  return b;
+}
+
+const Point kBase = BasePoint();
+
+// The order of the base point, L = 2^252 +
+// 27742317777372353535851937790883648493, little-endian.
+const int64_t kL[32] = {
+    0xed, 0xd3, 0xf5, 0x5c, 0x1a, 0x63, 0x12, 0x58, 0xd6, 0x9c, 0xf7,
+    0xa2, 0xde, 0xf9, 0xde, 0x14, 0,    0,    0,    0,    0,    0,
+    0,    0,    0,    0,    0,    0,    0,    0,    0,    0x10,
+};
+
+// Reduces the 64 byte-sized limbs of x modulo L into the 32 bytes of r (after
+// TweetNaCl). Limbs may be larger than a byte, or negative.
+void ModL(uint8_t* r, int64_t* x) {
+  for (int i = 63; i >= 32; --i) {
+    int64_t carry = 0;
+    int j;
+    for (j = i - 32; j < i - 12; ++j) {
+      x[j] += carry - 16 * x[i] * kL[j - (i - 32)];
+      carry = (x[j] + 128) >> 8;
+      x[j] -= carry * 256;
+    }
+    x[j] += carry;
+    x[i] = 0;
+  }
+  int64_t carry = 0;
+  for (int j = 0; j < 32; ++j) {
+    x[j] += carry - (x[31] >> 4) * kL[j];
+    carry = x[j] >> 8;
+    x[j] &= 255;
+  }
+  for (int j = 0; j < 32; ++j) x[j] -= carry * kL[j];
+  for (int i = 0; i < 32; ++i) {
+    x[i + 1] += x[i] >> 8;
+    r[i] = x[i] & 255;
+  }
+}
+
+// Reduces a 64 byte little-endian number modulo L into the 32 bytes of r.
+void Reduce(uint8_t* r, const Digest512& h) {
+  int64_t x[64];
+  for (int i = 0; i < 64; ++i) x[i] = h[i];
+  ModL(r, x);
+}
+
+// Returns SHA-512(a || b || data) reduced modulo L into the 32 bytes of r,
+// where a and b are 32 bytes long, or b is null.
+void HashToScalar(uint8_t* r, const uint8_t* a, const uint8_t* b,
+                  const void* data, size_t n) {
+  Sha512 h;
+  h.Update(a, 32);
+  if (b) h.Update(b, 32);
+  h.Update(data, n);
+  Reduce(r, h.Finish());
+}
+
+}  // namespace
+
+Ed25519Signer::Ed25519Signer(const SigningKey& seed) {
+  Sha512 h;
+  h.Update(seed.data(), seed.size());
+  Digest512 expanded = h.Finish();
+  memcpy(scalar_.data(), expanded.data(), 32);
+  memcpy(prefix_.data(), expanded.data() + 32, 32);
+  scalar_[0] &= 248;
+  scalar_[31] &= 127;
+  scalar_[31] |= 64;
+  Encode(public_key_.data(), ScalarMult(kBase, scalar_.data()));
+}
+
+Signature Ed25519Signer::Sign(const void* data, size_t n) const {
+  Signature sig;
+  uint8_t r[32];
+  HashToScalar(r, prefix_.data(), nullptr, data, n);
+  Encode(sig.data(), ScalarMult(kBase, r));
+
+  // S = (r + k * a) mod L.
+  uint8_t k[32];
+  HashToScalar(k, sig.data(), public_key_.data(), data, n);
+  int64_t x[64] = {};
+  for (int i = 0; i < 32; ++i) x[i] = r[i];
+  for (int i = 0; i < 32; ++i) {
+    for (int j = 0; j < 32; ++j) x[i + j] += k[i] * int64_t{scalar_[j]};
+  }
+  ModL(sig.data() + 32, x);
+  return sig;
+}
+
+bool Ed25519Verify(const VerifyingKey& key, const void* data, size_t n,
+                   const Signature& sig) {
+  // S must be below L.
+  const uint8_t* s = sig.data() + 32;
+  for (int i = 31; i >= 0; --i) {
+    if (s[i] < kL[i]) break;
+    if (s[i] > kL[i] || i == 0) return false;
+  }
+  Point a;
+  if (!Decode(key.data(), a)) {
+    return false;
+  }
+
+  // The signature is valid if R = [S]B - [k]A.
+  uint8_t k[32];
+  HashToScalar(k, sig.data(), key.data(), data, n);
+  Point r = DoubleScalarMultVartime(kBase, s, NegPoint(a), k);
+  uint8_t encoded[32];
+  Encode(encoded, r);
+  return memcmp(encoded, sig.data(), sizeof(encoded)) == 0;
+}
+
+}  // namespace crypto
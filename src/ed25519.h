@@ -0,0 +1,48 @@
+#ifndef ED25519_H_
+#define ED25519_H_
+
+#include <array>
+#include <cstdint>
+#include <string>
+
+namespace crypto {
+
+// SigningKey is the secret seed of an Ed25519 key pair, and VerifyingKey its
+// encoded public key. Both have the size of a Key, so they are read and written
+// like one (see KeyFromString), and a random seed is a random Key.
+typedef std::array<uint8_t, 32> SigningKey;
+typedef std::array<uint8_t, 32> VerifyingKey;
+// Signature is an encoded Ed25519 signature.
+typedef std::array<uint8_t, 64> Signature;
+
+// Signs data with Ed25519 (RFC 8032). The seed is expanded once up front, so
+// that each signature only costs hashing the data twice and a single scalar
+// multiplication. A self-contained implementation, like Sha256, which runs in
+// time independent of the secret key.
+class Ed25519Signer {
+ public:
+  explicit Ed25519Signer(const SigningKey& seed);
+
+  // Returns the public key that verifies the signatures of this signer.
+  inline const VerifyingKey& PublicKey() const { return public_key_; }
+
+  // Returns the signature of n bytes of data.
+  Signature Sign(const void* data, size_t n) const;
+
+ private:
+  // The secret scalar, and the prefix that derives the nonce of a signature.
+  std::array<uint8_t, 32> scalar_;
+  std::array<uint8_t, 32> prefix_;
+  VerifyingKey public_key_;
+};
+
+// Determines if the signature of n bytes of data is valid for the public key.
+// Rejects non-canonical encodings of the signature and the key, so that every
+// signature has a single valid encoding. Runs in variable time, since
+// everything it handles is public.
+bool Ed25519Verify(const VerifyingKey& key, const void* data, size_t n,
+                   const Signature& sig);
+
+}  // namespace crypto
+
+#endif
@@ -0,0 +1,658 @@
+#include "engine.h"
+
+#include "readiness.h"
+
+namespace generals {
+
+namespace {
+
+// Appends a uint32_t to the buffer in network byte order.
+inline void AppendU32(std::string& buf, uint32_t v) {
+  v = htonl(v);
+  buf.append(reinterpret_cast<const char*>(&v), sizeof(v));
+}
+
+// Reads a uint32_t in network byte order from the buffer. The buffer may not be
+// aligned, so the value is copied out instead of cast.
+inline uint32_t ReadU32(const char* buf) {
+  uint32_t v;
+  memcpy(&v, buf, sizeof(v));
+  return ntohl(v);
+}
+
+// Finalizes the header of a batch once all of its entries have been appended.
+void FinishBatch(std::string& buf, unsigned int count, uint32_t flags) {
+  msg::BatchMessage* header = reinterpret_cast<msg::BatchMessage*>(&buf[0]);
+  header->size = htonl(buf.size());
+  header->flags = htonl(flags);
+  header->count = htonl(count);
+}
+
+// Starts a new batch with the provided sender, round and sequence number.
+std::string StartBatch(unsigned int sender, unsigned int round,
+                       unsigned int seq) {
+  std::string buf;
+  buf.reserve(kMaxBatchSize);
+  AppendU32(buf, kBatchMessageType);
+  AppendU32(buf, 0);  // size, set by FinishBatch
+  AppendU32(buf, round);
+  AppendU32(buf, seq);
+  AppendU32(buf, sender);
+  AppendU32(buf, 0);  // flags, set by FinishBatch
+  AppendU32(buf, 0);  // count, set by FinishBatch
+  return buf;
+}
+
+}  // namespace
+
+std::experimental::optional<unsigned int> Schedule::InstanceRound(
+    unsigned int inst, unsigned int round) const {
+  unsigned int start = StartOfWave(WaveOf(inst));
+  if (round < start || round > start + last_round_) {
+    return {};
+  }
+  return round - start;
+}
+
+std::pair<unsigned int, unsigned int> Schedule::ActiveInstances(
+    unsigned int round) const {
+  // The first wave still running is the first one that has not yet passed its
+  // last round, and the last wave running is the last one that has started.
+  unsigned int first = 0;
+  if (round > last_round_) {
+    first = (round - last_round_ + stride_ - 1) / stride_;
+  }
+  unsigned int last = std::min(round / stride_ + 1, waves_);
+  first = std::min(first, last);
+  return {first * instances_, last * instances_};
+}
+
+std::vector<std::string> EncodeBatches(
+    unsigned int sender, unsigned int round,
+    const std::vector<msg::InstanceMessage>& msgs, bool done) {
+  bool authed = std::any_of(
+      msgs.begin(), msgs.end(),
+      [](const msg::InstanceMessage& im) { return !im.msg.auth.empty(); });
+  uint32_t flags = authed ? msg::kBatchAuth : 0;
+
+  std::vector<std::string> batches;
+  std::string buf = StartBatch(sender, round, 0);
+  unsigned int count = 0;
+  for (auto const& im : msgs) {
+    size_t auth_size = im.msg.auth.empty() ? 0 : im.msg.auth.front().size();
+    size_t entry_size = sizeof(msg::BatchEntry) +
+                        sizeof(uint32_t) * im.msg.ids.size() +
+                        (im.msg.value ? im.msg.value->size() : 0);
+    if (authed) {
+      entry_size += 3 * sizeof(uint32_t) + im.msg.value_digest.size() +
+                    auth_size * im.msg.auth.size();
+    }
+    if (count > 0 && buf.size() + entry_size > kMaxBatchSize) {
+      FinishBatch(buf, count, flags);
+      batches.push_back(std::move(buf));
+      buf = StartBatch(sender, round, batches.size());
+      count = 0;
+    }
+
+    AppendU32(buf, im.instance);
+    AppendU32(buf, im.msg.ids.size());
+    AppendU32(buf, im.msg.value ? im.msg.value->size() : kNoValue);
+    for (auto const& id : im.msg.ids) {
+      AppendU32(buf, id);
+    }
+    if (im.msg.value) {
+      buf.append(*im.msg.value);
+    }
+    if (authed) {
+      AppendU32(buf, im.msg.value_digest.size());
+      AppendU32(buf, im.msg.auth.size());
+      AppendU32(buf, auth_size);
+      buf.append(im.msg.value_digest);
+      for (auto const& auth : im.msg.auth) {
+        buf.append(auth, 0, auth_size);
+      }
+    }
+    count++;
+  }
+  // The last batch carries the done flag. If there are no messages at all, it
+  // is sent on its own.
+  if (count > 0 || done) {
+    FinishBatch(buf, count, flags | (done ? msg::kBatchDone : 0));
+    batches.push_back(std::move(buf));
+  }
+  return batches;
+}
+
+std::experimental::optional<Batch> BatchFromBuf(char* buf, size_t n) {
+  // Check to make sure the size of the buffer is correct.
+  if (n < sizeof(msg::BatchMessage)) {
+    return {};
+  }
+  if (ReadU32(buf) != kBatchMessageType || ReadU32(buf + 4) != n) {
+    return {};
+  }
+
+  Batch batch;
+  batch.round = ReadU32(buf + 8);
+  batch.seq = ReadU32(buf + 12);
+  batch.sender = ReadU32(buf + 16);
+  uint32_t flags = ReadU32(buf + 20);
+  batch.done = (flags & msg::kBatchDone) != 0;
+  bool authed = (flags & msg::kBatchAuth) != 0;
+  unsigned int count = ReadU32(buf + 24);
+
+  // Copy out each entry, making sure never to read past the end of the buffer.
+  size_t off = sizeof(msg::BatchMessage);
+  for (unsigned int i = 0; i < count; ++i) {
+    if (off + sizeof(msg::BatchEntry) > n) {
+      return {};
+    }
+    msg::InstanceMessage im;
+    im.instance = ReadU32(buf + off);
+    uint32_t id_count = ReadU32(buf + off + 4);
+    uint32_t value_size = ReadU32(buf + off + 8);
+    off += sizeof(msg::BatchEntry);
+    if (id_count == 0 || id_count > (n - off) / sizeof(uint32_t)) {
+      return {};
+    }
+
+    im.msg.round = 0;
+    im.msg.ids.resize(id_count);
+    for (size_t j = 0; j < id_count; ++j) {
+      im.msg.ids[j] = ReadU32(buf + off);
+      off += sizeof(uint32_t);
+    }
+    if (value_size != kNoValue) {
+      if (value_size > kMaxValueSize || value_size > n - off) {
+        return {};
+      }
+      im.msg.value = msg::Value(buf + off, value_size);
+      off += value_size;
+    }
+    if (authed) {
+      if (3 * sizeof(uint32_t) > n - off) {
+        return {};
+      }
+      size_t digest_size = ReadU32(buf + off);
+      size_t auth_count = ReadU32(buf + off + 4);
+      size_t auth_size = ReadU32(buf + off + 8);
+      off += 3 * sizeof(uint32_t);
+      if (digest_size > n - off) {
+        return {};
+      }
+      im.msg.value_digest.assign(buf + off, digest_size);
+      off += digest_size;
+      if (auth_size == 0 ? auth_count != 0
+                         : auth_count > (n - off) / auth_size) {
+        return {};
+      }
+      for (size_t j = 0; j < auth_count; ++j) {
+        im.msg.auth.emplace_back(buf + off, auth_size);
+        off += auth_size;
+      }
+    }
+    batch.msgs.push_back(std::move(im));
+  }
+  if (off != n) {
+    return {};
+  }
+  return batch;
+}
+
+bool SendBatches(udp::ClientPtr client, unsigned int sender, unsigned int round,
+                 const std::vector<msg::InstanceMessage>& msgs, bool done,
+                 MaliciousBehavior behavior, unsigned int attempts,
+                 RoundSkew* skew) {
+  for (auto const& buf : EncodeBatches(sender, round, msgs, done)) {
+    MaybeDelaySend(behavior);
+    auto sent = std::chrono::steady_clock::now();
+
+    // Passed to SendWithAck to verify that any acknowledgement we hear is for
+    // this exact batch.
+    const msg::BatchMessage* header =
+        reinterpret_cast<const msg::BatchMessage*>(buf.data());
+    uint32_t seq = ntohl(header->seq);
+    auto isValidAck = [round, seq, skew, sent](udp::ClientPtr client,
+                                               char* ackbuf, size_t n) {
+      bool valid = n == sizeof(msg::BatchAck) &&
+                   ReadU32(ackbuf) == kBatchAckType &&
+                   ReadU32(ackbuf + 8) == round && ReadU32(ackbuf + 12) == seq;
+      if (!valid) return udp::ServerAction::Continue;
+      if (skew) {
+        auto ack = reinterpret_cast<const msg::BatchAck*>(ackbuf);
+        skew->Sample(client.get(), round, sent,
+                     std::chrono::steady_clock::now(),
+                     ReadAckTiming(ack->hold_us, ack->elapsed_us));
+      }
+      return udp::ServerAction::Stop;
+    };
+
+    if (!client->SendWithAck(buf.data(), buf.size(), attempts, isValidAck)) {
+      // The process is not responding, so there is no use in stalling on the
+      // remaining batches as well.
+      LOG(INFO) << "Giving up on " << client->RemoteAddress() << " in round "
+                << round << "\n";
+      return false;
+    }
+  }
+  return true;
+}
+
+void SendBatchAck(udp::ClientPtr client, unsigned int round, unsigned int seq,
+                  const AckTiming& timing) {
+  msg::BatchAck ack = {};
+  ack.type = htonl(kBatchAckType);
+  ack.size = htonl(sizeof(ack));
+  ack.round = htonl(round);
+  ack.seq = htonl(seq);
+  WriteAckTiming(timing, &ack.hold_us, &ack.elapsed_us);
+
+  char* buf = reinterpret_cast<char*>(&ack);
+  client->Send(buf, sizeof(ack));
+}
+
+std::vector<msg::Value> CommanderEngine::DecideAll() {
+  // Every loyal Lieutenant answers once it listens, faulty ones may never.
+  WaitForReady(processes_, 0, processes_.size() - 1 - faulty_, link_auth_);
+
+  // Send in parallel so that some Lieutenants don't end up far ahead of
+  // others. Each Lieutenant receives the orders of all instances in a wave in
+  // shared batches, one wave after the other.
+  threadutil::ThreadGroup senders;
+  auto ids = std::vector<unsigned int>{0};
+  for (unsigned int pid = 1; pid < processes_.size(); ++pid) {
+    std::vector<std::vector<msg::InstanceMessage>> waves(schedule_.Waves());
+    for (unsigned int inst = 0; inst < schedule_.Instances(); ++inst) {
+      if (ShouldSendMsg(behavior_)) {
+        msg::Message msg{0, ValueForMsg(behavior_, values_[inst]), ids};
+        if (auth_) auth_->Sign(msg, inst);
+        waves[schedule_.WaveOf(inst)].push_back({inst, msg});
+      }
+    }
+
+    udp::ClientPtr client = ClientForId(pid);
+    senders.AddThread([this, client, pid, waves] {
+      for (unsigned int wave = 0; wave < waves.size(); ++wave) {
+        if (waves[wave].empty()) {
+          continue;
+        }
+        unsigned int round = schedule_.StartOfWave(wave);
+        LOG(DEBUG) << "Sending  " << waves[wave].size() << " messages to p"
+                   << pid << " for round " << round << "\n";
+        if (!SendBatches(client, id_, round, waves[wave], false, behavior_,
+                         ack_.attempts)) {
+          return;
+        }
+      }
+    });
+  }
+  senders.JoinAll();
+  LogAuthStats();
+  return values_;
+}
+
+std::vector<msg::Value> LieutenantEngine::DecideAll() {
+  auto active = schedule_.ActiveInstances(round_);
+  incomplete_this_round_ = active.second - active.first;
+  server_.Listen(
+      // Called on all incoming batches.
+      [this](udp::ClientPtr client, char* buf, size_t n) {
+        auto received = std::chrono::steady_clock::now();
+        AlignDeadline();
+
+        // Never decode datagrams that failed link authentication, and answer
+        // the Commander right away if it is checking that we listen.
+        if (!client->Authentic() || AnswerHello(client, buf, n, id_)) {
+          return udp::ServerAction::Continue;
+        }
+
+        auto batch = BatchFromBuf(buf, n);
+        if (!batch || !ValidBatch(*batch, client)) {
+          // If the batch was not valid, return without trying to use it.
+          return udp::ServerAction::Continue;
+        }
+        return HandleBatch(client, *batch, received);
+      },
+      // Called once the round deadline passes.
+      [this]() { return HandleRoundTimeout(); });
+
+  std::vector<msg::Value> decisions;
+  decisions.reserve(agreements_.size());
+  for (auto const& agreement : agreements_) {
+    decisions.push_back(agreement->Decide());
+  }
+  return decisions;
+}
+
+udp::ServerAction LieutenantEngine::HandleBatch(
+    udp::ClientPtr client, const Batch& batch,
+    std::chrono::steady_clock::time_point received) {
+  unsigned int sender = batch.sender;
+  if (Early(batch.round)) {
+    // Buffer batches from later rounds until their round starts, as long as
+    // the sender has not exceeded its share of the buffer. Otherwise, do not
+    // acknowledge the batch so that it is sent again later.
+    if (buffered_per_sender_[sender] >= kMaxBufferedBatches) {
+      return udp::ServerAction::Continue;
+    }
+    LOG(DEBUG) << "Buffered " << batch.msgs.size() << " messages from p"
+               << sender << " for round " << batch.round << "\n";
+    SendBatchAck(client, batch.round, batch.seq, TimingForAck(received, {}));
+    future_batches_.emplace(batch.round, batch);
+    buffered_per_sender_[sender]++;
+    return udp::ServerAction::Continue;
+  }
+
+  LOG(DEBUG) << "Received " << batch.msgs.size() << " messages from p"
+             << sender << "\n";
+  SendBatchAck(client, batch.round, batch.seq,
+               TimingForAckOf(batch.round, received));
+  NoteArrival(batch.round);
+
+  // Retransmissions of batches from previous rounds are acknowledged so that
+  // their sender stops, but their messages are no longer of any use.
+  if (batch.round != round_) {
+    return udp::ServerAction::Continue;
+  }
+  if (!round_start_ts_) {
+    StartRoundClock();
+  }
+
+  ReceiveBatch(batch);
+  if (incomplete_this_round_ == 0) {
+    return MoveToNewRoundOrStop();
+  }
+  return udp::ServerAction::Continue;
+}
+
+void LieutenantEngine::ReceiveBatch(const Batch& batch) {
+  for (auto const& im : batch.msgs) {
+    auto inst_round = schedule_.InstanceRound(im.instance, round_);
+    msg::Message msg = im.msg;
+    msg.round = *inst_round;
+    if (agreements_[im.instance]->Receive(std::move(msg), *inst_round)) {
+      incomplete_this_round_--;
+    }
+  }
+
+  // A done batch marks its sender done in every running instance.
+  if (batch.done) {
+    auto active = schedule_.ActiveInstances(round_);
+    for (unsigned int inst = active.first; inst < active.second; ++inst) {
+      auto inst_round = schedule_.InstanceRound(inst, round_);
+      if (agreements_[inst]->ReceiveDone(batch.sender, *inst_round)) {
+        incomplete_this_round_--;
+      }
+    }
+  }
+}
+
+udp::ServerAction LieutenantEngine::HandleRoundTimeout() {
+  // The timer also fires once the round is prepared.
+  if (transitioning_) {
+    return StartRoundIfPrepared();
+  }
+  if (!round_start_ts_) {
+    // We can't timeout in the first round before hearing from anyone. Just
+    // continue to wait.
+    return udp::ServerAction::Continue;
+  }
+
+  // The deadline may have moved later since it was armed.
+  AlignDeadline();
+  if (std::chrono::steady_clock::now() < deadline_ts_) {
+    return udp::ServerAction::Continue;
+  }
+
+  LOG(INFO) << "Timeout in round " << round_ << " with "
+            << incomplete_this_round_ << " incomplete instances\n";
+  return MoveToNewRoundOrStop();
+}
+
+udp::ServerAction LieutenantEngine::MoveToNewRoundOrStop() {
+  if (!LastRound()) {
+    BeginRound();
+    return udp::ServerAction::Continue;
+  }
+  EndRound();
+  ClearSenders();
+  LogAuthStats();
+  return udp::ServerAction::Stop;
+}
+
+void LieutenantEngine::StartRoundClock() {
+  round_start_ts_ = std::chrono::steady_clock::now();
+  skew_.StartRound(round_, *round_start_ts_);
+  deadline_ts_ = *round_start_ts_ + deadline_.Current();
+  server_.SetDeadline(deadline_ts_);
+}
+
+AckTiming LieutenantEngine::TimingForAckOf(
+    unsigned int round, std::chrono::steady_clock::time_point received) const {
+  if (round != round_ || transitioning_) {
+    return TimingForAck(received, {});
+  }
+  return TimingForAck(received, round_start_ts_);
+}
+
+void LieutenantEngine::AlignDeadline() {
+  if (!round_start_ts_ || transitioning_) {
+    return;
+  }
+  auto aligned = *round_start_ts_ + deadline_.Current() +
+                 skew_.Offset(deadline_.Current() / kMaxSkewFraction);
+  if (aligned != deadline_ts_) {
+    deadline_ts_ = aligned;
+    server_.SetDeadline(deadline_ts_);
+  }
+}
+
+void LieutenantEngine::NoteArrival(unsigned int round) {
+  if (FirstRound() || transitioning_) {
+    return;
+  }
+  if (round < round_) {
+    late_this_round_ = true;
+    return;
+  }
+  if (round == round_) {
+    last_arrival_ = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - *round_start_ts_);
+  }
+}
+
+void LieutenantEngine::EndRound() {
+  // The first round has no start to measure from (see round_start_ts_).
+  if (FirstRound()) {
+    return;
+  }
+
+  LOG(INFO) << "Round " << round_ << " deadline was "
+            << deadline_.Current().count() << "us";
+  auto shift = std::chrono::duration_cast<std::chrono::microseconds>(
+      deadline_ts_ - *round_start_ts_ - deadline_.Current());
+  if (shift.count() != 0) {
+    LOG(INFO) << ", aligned by " << shift.count() << "us";
+  }
+  if (late_this_round_) {
+    LOG(INFO) << ", batches from earlier rounds arrived late\n";
+    deadline_.Backoff();
+  } else if (last_arrival_) {
+    LOG(INFO) << ", last batch arrived after " << last_arrival_->count()
+              << "us\n";
+    deadline_.Record(*last_arrival_);
+  } else {
+    LOG(INFO) << ", no batches arrived\n";
+  }
+}
+
+LieutenantEngine::~LieutenantEngine() {
+  if (transition_.joinable()) transition_.join();
+  ClearSenders();
+}
+
+void LieutenantEngine::ClearSenders() {
+  sender_threads_this_round_.JoinAll();
+  sender_threads_this_round_.Clear();
+}
+
+void LieutenantEngine::BeginRound() {
+  EndRound();
+  LogAuthStats();
+  if (auth_) auth_->EndRound();
+  IncrementRound();
+  transitioning_ = true;
+  transition_ = std::thread([this] { PrepareRound(); });
+}
+
+void LieutenantEngine::PrepareRound() {
+  // The senders of the previous round share their clients with those of this
+  // one, so they have to be done first.
+  ClearSenders();
+
+  // Determine the set of messages to send in the next round, grouping the
+  // messages of all running instances by destination process. Instances that
+  // are just starting have nothing to send yet. When sending done markers,
+  // every other Lieutenant is sent a done batch, even without messages.
+  bool send_done = spec_.SendsDone();
+  std::unordered_map<unsigned int, std::vector<msg::InstanceMessage>> toSend;
+  if (send_done) {
+    for (unsigned int pid = 1; pid < processes_.size(); ++pid) {
+      if (pid != id_) toSend[pid];
+    }
+  }
+  auto active = schedule_.ActiveInstances(round_);
+  for (unsigned int inst = active.first; inst < active.second; ++inst) {
+    auto inst_round = schedule_.InstanceRound(inst, round_);
+    if (*inst_round == 0) {
+      continue;
+    }
+    Outbox outbox = agreements_[inst]->NextRound(*inst_round);
+    if (auth_) auth_->SignOutbox(outbox, inst);
+    for (auto const& batch : outbox) {
+      for (auto const& msg : batch.second) {
+        if (ShouldSendMsg(behavior_)) {
+          toSend[batch.first].push_back({inst, msg});
+        }
+      }
+    }
+  }
+
+  // For each process that we have messages to send to...
+  for (auto const& batch : toSend) {
+    LOG(DEBUG) << "Sending  " << batch.second.size() << " messages to p"
+               << batch.first << "\n";
+    unsigned int round = round_;
+    bool done = send_done && ShouldSendMsg(behavior_);
+    sender_threads_this_round_.AddThread([this, batch, round, done] {
+      // Send the messages to the process in batches in a new thread.
+      udp::ClientPtr client = ClientForId(batch.first);
+      SendBatches(client, id_, round, batch.second, done, behavior_,
+                  ack_.attempts, &skew_);
+    });
+  }
+
+  std::lock_guard<std::mutex> lock(transition_mu_);
+  transition_ready_ = true;
+  server_.SetDeadline(std::chrono::steady_clock::now());
+}
+
+udp::ServerAction LieutenantEngine::StartRoundIfPrepared() {
+  // The server was woken up by a deadline of the previous round.
+  {
+    std::lock_guard<std::mutex> lock(transition_mu_);
+    if (!transition_ready_) {
+      return udp::ServerAction::Continue;
+    }
+    transition_ready_ = false;
+  }
+  transition_.join();
+  transitioning_ = false;
+
+  // Reset per-round state and the round start timestamp.
+  auto active = schedule_.ActiveInstances(round_);
+  incomplete_this_round_ = 0;
+  for (unsigned int inst = active.first; inst < active.second; ++inst) {
+    auto inst_round = schedule_.InstanceRound(inst, round_);
+    if (!agreements_[inst]->RoundComplete(*inst_round)) {
+      incomplete_this_round_++;
+    }
+  }
+  last_arrival_ = {};
+  late_this_round_ = false;
+  StartRoundClock();
+
+  // Replay the batches that arrived early for this round.
+  auto early = future_batches_.equal_range(round_);
+  for (auto it = early.first; it != early.second; ++it) {
+    ReceiveBatch(it->second);
+    buffered_per_sender_[it->second.sender]--;
+  }
+  future_batches_.erase(early.first, early.second);
+
+  // Buffered batches may complete the round as soon as it starts, as may
+  // instances that expect no messages, in which case we move on right away.
+  if (incomplete_this_round_ == 0) {
+    return MoveToNewRoundOrStop();
+  }
+  return udp::ServerAction::Continue;
+}
+
+bool LieutenantEngine::ValidBatch(const Batch& batch,
+                                  udp::ClientPtr client) const {
+  // Invalid if the batch is from after the last round.
+  if (batch.round > schedule_.LastRound()) {
+    return false;
+  }
+  // Invalid if the sender is out of bounds or ourselves.
+  if (batch.sender >= processes_.size() || batch.sender == id_) {
+    return false;
+  }
+  for (auto const& im : batch.msgs) {
+    // Invalid if the instance does not exist.
+    if (im.instance >= schedule_.Instances()) {
+      return false;
+    }
+    // Invalid if the instance is not running in the batch's round.
+    auto inst_round = schedule_.InstanceRound(im.instance, batch.round);
+    if (!inst_round) {
+      return false;
+    }
+    // Invalid if the instance does not expect the message in its round.
+    if (!agreements_[im.instance]->ValidMessage(im.msg, *inst_round)) {
+      return false;
+    }
+    // Invalid if the message was not sent by the batch's sender.
+    if (im.msg.ids.back() != batch.sender) {
+      return false;
+    }
+  }
+  // Invalid if the batch was not sent by its sender.
+  if (!SentBy(processes_, client, batch.sender)) {
+    return false;
+  }
+  // Invalid if any message is not authentic. All messages of a batch are
+  // verified at once, on the worker pool if there are many of them.
+  if (auth_) {
+    std::atomic<bool> authentic{true};
+    auto verify = [this, &batch, &authentic](size_t i) {
+      auto const& im = batch.msgs[i];
+      if (!auth_->Verify(im.msg, im.instance)) {
+        authentic = false;
+      }
+    };
+    if (batch.msgs.size() >= kMinParallelVerify && verify_pool_.Size() > 0) {
+      verify_pool_.ParallelFor(batch.msgs.size(), verify);
+    } else {
+      for (size_t i = 0; i < batch.msgs.size(); ++i) {
+        verify(i);
+      }
+    }
+    if (!authentic) {
+      return false;
+    }
+  }
+  return true;
+}
+
+}  // namespace generals
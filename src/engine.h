@@ -0,0 +1,378 @@
+#ifndef ENGINE_H_
+#define ENGINE_H_
+
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <experimental/optional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "auth.h"
+#include "general.h"
+#include "log.h"
+#include "message.h"
+#include "net.h"
+#include "protocol.h"
+#include "thread.h"
+#include "udp_conn.h"
+
+namespace generals {
+
+// The maximum size of a batch datagram. Chosen so that a batch fits in a single
+// Ethernet frame and is never fragmented.
+const size_t kMaxBatchSize = 1472;
+
+// The maximum number of batches from a single process that a Lieutenant will
+// buffer for later rounds. Bounds the memory a faulty process can consume.
+const size_t kMaxBufferedBatches = 4096;
+
+// The minimum number of messages in a batch for their authenticators to be
+// verified on the worker pool instead of inline.
+const size_t kMinParallelVerify = 8;
+
+// Describes when each instance run by an Engine starts. Instances are grouped
+// into waves of equal size that run back-to-back: the first round of each wave
+// starts stride rounds after the first round of the previous one. Without
+// pipelining, the stride is the number of rounds an instance takes, so waves do
+// not overlap. With pipelining, the stride is one, so that a new wave starts
+// every round and in steady state one wave is decided per round. Each instance
+// runs from its round 0 up to the provided last round of the protocol.
+class Schedule {
+ public:
+  Schedule(unsigned int instances, unsigned int waves, unsigned int last_round,
+           bool pipeline)
+      : instances_(instances),
+        waves_(waves),
+        last_round_(last_round),
+        stride_(pipeline ? 1 : last_round + 1) {}
+
+  // Returns the total number of instances over all waves.
+  inline unsigned int Instances() const { return instances_ * waves_; }
+  // Returns the number of waves.
+  inline unsigned int Waves() const { return waves_; }
+  // Returns the wave of the provided instance.
+  inline unsigned int WaveOf(unsigned int inst) const {
+    return inst / instances_;
+  }
+  // Returns the round in which the provided wave starts.
+  inline unsigned int StartOfWave(unsigned int wave) const {
+    return wave * stride_;
+  }
+  // Returns the last round of the schedule, in which the last wave finishes.
+  inline unsigned int LastRound() const {
+    return StartOfWave(waves_ - 1) + last_round_;
+  }
+
+  // Returns the round of the provided instance during the provided round of
+  // the schedule, if the instance is running then. If not, the return value
+  // will be absent.
+  std::experimental::optional<unsigned int> InstanceRound(
+      unsigned int inst, unsigned int round) const;
+
+  // Returns the range [first, last) of instances running during the provided
+  // round of the schedule.
+  std::pair<unsigned int, unsigned int> ActiveInstances(
+      unsigned int round) const;
+
+ private:
+  const unsigned int instances_;
+  const unsigned int waves_;
+  const unsigned int last_round_;
+  const unsigned int stride_;
+};
+
+// Batch is a convenient representation of a decoded BatchMessage.
+struct Batch {
+  unsigned int round;
+  unsigned int seq;
+  unsigned int sender;
+  bool done;
+  std::vector<msg::InstanceMessage> msgs;
+};
+
+// Encodes the messages into as few BatchMessage datagrams as possible, none of
+// which is larger than kMaxBatchSize unless a single message is. Datagrams are
+// numbered sequentially within the round. If done is set, the last datagram
+// marks the sender done with the round, and one is produced even if there are
+// no messages. If any message carries authenticators, all datagrams do.
+std::vector<std::string> EncodeBatches(
+    unsigned int sender, unsigned int round,
+    const std::vector<msg::InstanceMessage>& msgs, bool done);
+
+// Decodes a Batch from the provided buffer. If the decoding is successful, the
+// optional return value will be present. If not, the return value will be
+// absent. The round of each message within its instance is not part of the
+// batch, because it is implied by the round of the batch and the Schedule, so
+// it is left zero.
+std::experimental::optional<Batch> BatchFromBuf(char* buf, size_t n);
+
+// Sends the messages to the client in batches, waiting for an acknowledgement
+// of each one before sending the next. Gives up on the remaining batches once
+// one of them is never acknowledged. Possibly delays each batch based on the
+// provided behavior. Each batch is sent up to attempts times. If skew is
+// provided, the acknowledgements are sampled by it. Returns whether all batches
+// were acknowledged.
+bool SendBatches(udp::ClientPtr client, unsigned int sender, unsigned int round,
+                 const std::vector<msg::InstanceMessage>& msgs, bool done,
+                 MaliciousBehavior behavior, unsigned int attempts,
+                 RoundSkew* skew = nullptr);
+
+// Sends an acknowledgement for the batch with the provided round and sequence
+// number to the client.
+void SendBatchAck(udp::ClientPtr client, unsigned int round, unsigned int seq,
+                  const AckTiming& timing);
+
+// An abstract representation of a process running many independent instances
+// of the Byzantine Agreement Algorithm at once. All instances share the rounds
+// and UDP transport of the process, and messages from all instances for the
+// same peer and round are batched into shared datagrams. Instances start
+// according to a Schedule, so that the rounds of consecutive waves can overlap.
+// Extended by the CommanderEngine and LieutenantEngine classes. Messages are
+// authenticated with auth and datagrams with link_auth, unless they are null,
+// and acknowledged according to ack.
+class Engine {
+ public:
+  Engine(const ProcessList& processes, unsigned int id, unsigned int faulty,
+         MaliciousBehavior behavior, const Schedule& schedule,
+         std::shared_ptr<const MessageAuth> auth, udp::LinkAuthPtr link_auth,
+         const AckPolicy& ack)
+      : processes_(processes),
+        clients_(ClientsForProcessList(processes, link_auth, ack.timeout)),
+        id_(id),
+        faulty_(faulty),
+        behavior_(behavior),
+        schedule_(schedule),
+        auth_(auth),
+        ack_(ack),
+        round_(0) {}
+
+  virtual ~Engine() = default;
+
+  // Runs all instances of the Byzantine Agreement Algorithm and decides on a
+  // value for each of them by coordinating with peer processes. The result is
+  // indexed by instance.
+  virtual std::vector<msg::Value> DecideAll() = 0;
+
+ protected:
+  const ProcessList processes_;
+  const UdpClientMap clients_;
+  const unsigned int id_;
+  const unsigned int faulty_;
+  const MaliciousBehavior behavior_;
+  const Schedule schedule_;
+  const std::shared_ptr<const MessageAuth> auth_;
+  const AckPolicy ack_;
+
+  // Returns the UDP client for a given process ID.
+  inline udp::ClientPtr ClientForId(unsigned int pid) const {
+    return clients_.at(processes_.at(pid));
+  }
+
+  // The round of the schedule. Each instance has its own round, which is
+  // offset by the start of its wave.
+  unsigned int round_;
+  // Determines if this is the first round of the schedule.
+  inline bool FirstRound() const { return round_ == 0; }
+  // Determines if this is the last round of the schedule.
+  inline bool LastRound() const { return round_ == schedule_.LastRound(); };
+  // Increments the round number.
+  inline void IncrementRound() {
+    round_++;
+    LOG(INFO) << "Moving to round " << round_ << "\n";
+  };
+
+  // Logs the authentication work done since the last call (see
+  // General::LogAuthStats).
+  inline void LogAuthStats() const {
+    if (auth_) {
+      LOG(INFO) << "Round " << round_ << " authentication: "
+                << auth_->TakeStats() << "\n";
+    }
+  }
+};
+
+// A commander process proposing a value in each of many concurrent instances.
+// The values of all waves are sent up front, wave after wave, and buffered by
+// the Lieutenants until the wave starts. They are sent once the loyal
+// Lieutenants are ready (see WaitForReady).
+class CommanderEngine : public Engine {
+ public:
+  CommanderEngine(const ProcessList& processes, unsigned int faulty,
+                  std::vector<msg::Value> values, MaliciousBehavior behavior,
+                  const Schedule& schedule,
+                  std::shared_ptr<const MessageAuth> auth = nullptr,
+                  udp::LinkAuthPtr link_auth = nullptr,
+                  const AckPolicy& ack = kDefaultAckPolicy)
+      : Engine(processes, 0, faulty, behavior, schedule, auth, link_auth,
+               ack),
+        link_auth_(link_auth),
+        values_(values) {}
+
+  std::vector<msg::Value> DecideAll();
+
+ private:
+  const udp::LinkAuthPtr link_auth_;
+  const std::vector<msg::Value> values_;
+};
+
+// A lieutenant process participating in many concurrent instances of the
+// provided protocol. Each instance keeps its own Protocol state, while the
+// round clock, the udp::Server and the sender threads are shared. Rounds time
+// out after the provided deadline, which adapts to observed latency.
+class LieutenantEngine : public Engine {
+ public:
+  LieutenantEngine(const ProcessList& processes, unsigned int id,
+                   unsigned short server_port, unsigned int faulty,
+                   MaliciousBehavior behavior, const Schedule& schedule,
+                   const ProtocolSpec& spec,
+                   std::shared_ptr<const MessageAuth> auth = nullptr,
+                   udp::LinkAuthPtr link_auth = nullptr,
+                   const RoundDeadline& deadline =
+                       RoundDeadline(MinRoundTimeout(kDefaultAckPolicy),
+                                     kRoundTimeout),
+                   const AckPolicy& ack = kDefaultAckPolicy)
+      : Engine(processes, id, faulty, behavior, schedule, auth, link_auth,
+               ack),
+        server_(server_port, link_auth),
+        spec_(spec),
+        verify_pool_(
+            auth ? std::max(1u, std::thread::hardware_concurrency()) - 1 : 0),
+        deadline_(deadline),
+        skew_(ack.timeout),
+        late_this_round_(false),
+        transitioning_(false),
+        transition_ready_(false) {
+    agreements_.reserve(schedule.Instances());
+    for (unsigned int inst = 0; inst < schedule.Instances(); ++inst) {
+      agreements_.push_back(spec.New(id));
+    }
+  }
+  ~LieutenantEngine();
+
+  std::vector<msg::Value> DecideAll();
+
+ private:
+  const udp::Server server_;
+  const ProtocolSpec spec_;
+
+  // The state of each agreement instance, indexed by instance.
+  std::vector<std::unique_ptr<Protocol>> agreements_;
+
+  // Verifies the authenticators of large batches in parallel. The receiving
+  // thread takes part too, so the pool is one thread short of the number of
+  // cores.
+  mutable threadutil::WorkerPool verify_pool_;
+
+  // Batches received ahead of the round they belong to, keyed by round. They
+  // are acknowledged immediately and replayed once their round starts, so that
+  // processes that are ahead, like the Commander sending later waves, do not
+  // have to retransmit.
+  std::multimap<unsigned int, Batch> future_batches_;
+  // The number of batches buffered in future_batches_ per sending process.
+  std::unordered_map<unsigned int, size_t> buffered_per_sender_;
+
+  // The deadline of each round, learned from the rounds before it.
+  RoundDeadline deadline_;
+  // Estimates when the other processes started the round (see
+  // Lieutenant::skew_).
+  RoundSkew skew_;
+
+  // Per-round variables:
+
+  // Timestamp at the begining of the round (see Lieutenant::round_start_ts_).
+  // In the first round, the timer is only started once the first batch is
+  // received.
+  std::experimental::optional<std::chrono::steady_clock::time_point>
+      round_start_ts_;
+  // The time the round ends (see Lieutenant::deadline_ts_).
+  std::chrono::steady_clock::time_point deadline_ts_;
+  // The time since the start of the round at which its last batch arrived, if
+  // any did (see Lieutenant::last_arrival_).
+  std::experimental::optional<std::chrono::microseconds> last_arrival_;
+  // Whether a batch from an earlier round arrived during this round.
+  bool late_this_round_;
+  // The number of running instances that have not yet completed the current
+  // round.
+  size_t incomplete_this_round_;
+  // Whether the round was entered, but is still being prepared by
+  // transition_ (see Lieutenant::transitioning_).
+  bool transitioning_;
+  // Prepares the round while the server keeps receiving (see BeginRound).
+  std::thread transition_;
+  // Whether transition_ is done preparing the round, guarded by
+  // transition_mu_.
+  std::mutex transition_mu_;
+  bool transition_ready_;
+  // Holds the sender threads for the given round.
+  threadutil::ThreadGroup sender_threads_this_round_;
+
+  // Handles a decoded batch received from the client at the provided time.
+  udp::ServerAction HandleBatch(udp::ClientPtr client, const Batch& batch,
+                                std::chrono::steady_clock::time_point received);
+  // Hands the messages of a batch from the current round to their instances,
+  // stamped with the round of their instance.
+  void ReceiveBatch(const Batch& batch);
+
+  // Starts the timer of the round now, and arms its deadline.
+  void StartRoundClock();
+  // Returns the timing of an acknowledgement for the provided round of a
+  // datagram received at the provided time.
+  AckTiming TimingForAckOf(
+      unsigned int round, std::chrono::steady_clock::time_point received) const;
+  // Moves the end of the round to align it with the other processes (see
+  // Lieutenant::AlignDeadline).
+  void AlignDeadline();
+
+  // Records the arrival of a valid batch from the provided round for the round
+  // deadline.
+  void NoteArrival(unsigned int round);
+  // Reports the timing of the round that is ending and feeds it to the round
+  // deadline.
+  void EndRound();
+
+  // Handles a round timeout, moving to the next round if necessary.
+  udp::ServerAction HandleRoundTimeout();
+  // Handles moving to the next round, unless this is as already the last round.
+  udp::ServerAction MoveToNewRoundOrStop();
+
+  // Determines if batches from the provided round have to wait for it to
+  // start: either it is a later round, or it is still being prepared.
+  inline bool Early(unsigned int round) const {
+    return round > round_ || (round == round_ && transitioning_);
+  }
+
+  // Waits for all sender threads to drain and terminate before clearing the
+  // sender_threads_this_round_ vector.
+  void ClearSenders();
+  // Ends the current round and enters the next one, which transition_ prepares
+  // in the background (see PrepareRound), while the server keeps receiving and
+  // buffers its batches.
+  void BeginRound();
+  // Runs on transition_: waits for the senders of the previous round, collects
+  // the messages every instance needs to forward and launches one thread
+  // (sender) per destination process to send them in shared batches. Then
+  // wakes up the server through its round timer.
+  void PrepareRound();
+  // Starts the round once transition_ is done preparing it, setting up
+  // per-round variables and replaying the batches buffered for it. Moves on
+  // right away if every instance completes the round without any more.
+  udp::ServerAction StartRoundIfPrepared();
+
+  // Validates that every message in the batch makes sense to its instance in
+  // the batch's round, which must not be past the end of the schedule, and
+  // that they were all sent by the batch's sender, which must have sent the
+  // datagram of the client (see SentBy). If messages are authenticated, all
+  // messages must be authentic. A batch with any invalid message is rejected
+  // as a whole.
+  bool ValidBatch(const Batch& batch, udp::ClientPtr client) const;
+};
+
+}  // namespace generals
+
+#endif
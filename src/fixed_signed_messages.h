@@ -0,0 +1,270 @@
+#ifndef FIXED_SIGNED_MESSAGES_H_
+#define FIXED_SIGNED_MESSAGES_H_
+
+#include <array>
+#include <bitset>
+#include <cstddef>
+#include <cstdint>
+#include <experimental/optional>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "message.h"
+#include "protocol.h"
+#include "sha256.h"
+#include "signed_messages.h"
+
+namespace generals {
+
+// Returns the maximum number of valid messages that a Lieutenant should expect
+// in a certain round given a number of processes (see MessagesForRound), at
+// compile time.
+constexpr size_t FixedMessagesForRound(size_t process_num, size_t round) {
+  size_t count = 1;
+  for (size_t r = 1; r <= round; ++r) {
+    count *= process_num - 1 - r;
+  }
+  return count;
+}
+
+// Returns the largest number of messages expected in any of the provided
+// rounds.
+constexpr size_t FixedMaxMessages(size_t process_num, size_t last_round) {
+  size_t max = 0;
+  for (size_t r = 0; r <= last_round; ++r) {
+    size_t count = FixedMessagesForRound(process_num, r);
+    if (count > max) max = count;
+  }
+  return max;
+}
+
+// Returns the table of FixedMessagesForRound for rounds 0 up to the number of
+// provided rounds.
+template <size_t N, size_t... R>
+constexpr std::array<size_t, sizeof...(R)> FixedMessagesTable(
+    std::index_sequence<R...>) {
+  return {{FixedMessagesForRound(N, R)...}};
+}
+
+// The largest number of messages per round FixedSignedMessages stores inline.
+// Larger systems should use the dynamic SignedMessages instead.
+const size_t kMaxFixedMessages = 1 << 16;
+
+// Holds the state of a single instance of the algorithm with signed messages,
+// like SignedMessages, for a system of exactly N processes tolerating F faulty
+// ones, both known at compile time. Only relays every message (RelayMode::ALL).
+//
+// Knowing the size of the system up front replaces every dynamically sized
+// container on the hot path: paths are arrays of F + 2 bytes, the expected
+// number of messages per round is a constexpr table, membership in a path is a
+// bitmask of N bits, and the messages of a round live in a fixed array indexed
+// by the rank of their path. The rank of a path is its position among all
+// valid paths of its length, which also makes detecting replays a single bit
+// test.
+template <size_t N, size_t F>
+class FixedSignedMessages : public Protocol {
+  static_assert(N <= 256, "process ids must fit in a byte");
+  static_assert(F + 2 <= N, "there must be at least faulty + 2 processes");
+  static_assert(FixedMaxMessages(N, F + 1) <= kMaxFixedMessages,
+                "too many messages per round to store inline");
+
+ public:
+  // The number of rounds, and the longest path of any message.
+  static constexpr size_t kRounds = F + 2;
+  // The largest number of messages expected in any round.
+  static constexpr size_t kMaxMessages = FixedMaxMessages(N, F + 1);
+
+  typedef std::array<uint8_t, kRounds> Path;
+  typedef std::bitset<N> ProcessSet;
+
+  FixedSignedMessages(unsigned int id,
+                      msg::Value default_value =
+                          msg::OrderValue(msg::Order::RETREAT))
+      : id_(id),
+        default_value_(std::move(default_value)),
+        entries_(kMaxMessages),
+        count_(0) {}
+
+  // Validates the path of the message (see ValidPath).
+  bool ValidMessage(const msg::Message& msg, unsigned int round) const {
+    if (round >= kRounds || round + 1 != msg.ids.size()) {
+      return false;
+    }
+    if (msg.ids[0] != 0) {
+      return false;
+    }
+    ProcessSet members;
+    for (auto const& pid : msg.ids) {
+      if (pid >= N || pid == id_ || members.test(pid)) {
+        return false;
+      }
+      members.set(pid);
+    }
+    return true;
+  }
+
+  bool Receive(msg::Message msg, unsigned int round) {
+    size_t rank = Rank(msg);
+    if (round == 0) {
+      // Only handle the first real value.
+      if (msg.value && values_seen_.size() == 0) {
+        SeeValue(*msg.value);
+        Store(rank, std::move(msg));
+        return true;
+      }
+      return false;
+    }
+
+    // Handle if not a replay of a previous message (msg with same ids).
+    if (seen_.test(rank)) {
+      return false;
+    }
+
+    // Relay values we have already seen as no value (see SignedMessages).
+    if (!msg.value || !SeeValue(*msg.value)) {
+      DropValue(msg);
+    }
+    Store(rank, std::move(msg));
+    return RoundComplete(round);
+  }
+
+  bool RoundComplete(unsigned int round) const {
+    if (round == 0) {
+      return count_ > 0;
+    }
+    return round < kRounds && count_ == kMessagesForRound[round];
+  }
+
+  Outbox NextRound(unsigned int round) {
+    Outbox toSend;
+    size_t expected = round > 0 ? kMessagesForRound[round - 1] : 0;
+    for (size_t rank = 0; rank < expected; ++rank) {
+      if (!seen_.test(rank)) {
+        continue;
+      }
+      Entry& entry = entries_[rank];
+
+      // Relay the message with our id added to every process not in its path.
+      msg::Message msg;
+      msg.round = round;
+      msg.value = std::move(entry.value);
+      msg.auth = std::move(entry.auth);
+      msg.value_digest = std::move(entry.value_digest);
+      msg.ids.reserve(round + 1);
+      ProcessSet members;
+      for (size_t i = 0; i < round; ++i) {
+        msg.ids.push_back(entry.path[i]);
+        members.set(entry.path[i]);
+      }
+      msg.ids.push_back(id_);
+      members.set(id_);
+
+      for (unsigned int pid = 0; pid < N; ++pid) {
+        if (!members.test(pid)) {
+          toSend[pid].push_back(msg);
+        }
+      }
+    }
+
+    // Clear round-specific state.
+    seen_.reset();
+    count_ = 0;
+    return toSend;
+  }
+
+  // Decides like SignedMessages::Decide.
+  msg::Value Decide() const {
+    if (values_seen_.size() == 1) {
+      return first_value_;
+    }
+    return default_value_;
+  }
+
+ private:
+  // The expected number of messages in each round.
+  static constexpr std::array<size_t, kRounds> kMessagesForRound =
+      FixedMessagesTable<N>(std::make_index_sequence<kRounds>());
+
+  // A message received this round, stored at the rank of its path.
+  struct Entry {
+    Path path;
+    std::experimental::optional<msg::Value> value;
+    std::vector<std::string> auth;
+    std::string value_digest;
+  };
+
+  const unsigned int id_;
+  const msg::Value default_value_;
+
+  // The digests of the unique values seen, and the first of them, like in
+  // SignedMessages.
+  std::set<crypto::Digest> values_seen_;
+  msg::Value first_value_;
+
+  // Per-round variables:
+
+  // The messages received this round, indexed by the rank of their path.
+  // Allocated once, since kMaxMessages may be too large for the stack.
+  std::vector<Entry> entries_;
+  // The ranks of the paths received this round.
+  std::bitset<kMaxMessages> seen_;
+  // The number of messages received this round.
+  size_t count_;
+
+  // Returns the rank of the path of a valid message: the path is read as a
+  // mixed radix number, where the digit of each id after the Commander's is
+  // its index among the Lieutenants other than ourselves not yet in the path.
+  size_t Rank(const msg::Message& msg) const {
+    ProcessSet used;
+    size_t rank = 0;
+    for (size_t j = 1; j < msg.ids.size(); ++j) {
+      unsigned int pid = msg.ids[j];
+      // Count the unused candidates below pid, which excludes the Commander,
+      // ourselves and the ids earlier in the path. Shifting drops the ids at
+      // or above pid.
+      size_t below = (used << (N - pid)).count();
+      size_t digit = pid - 1 - (id_ < pid ? 1 : 0) - below;
+      rank = rank * (N - 1 - j) + digit;
+      used.set(pid);
+    }
+    return rank;
+  }
+
+  // Stores the message at the provided rank.
+  void Store(size_t rank, msg::Message msg) {
+    Entry& entry = entries_[rank];
+    for (size_t i = 0; i < msg.ids.size(); ++i) {
+      entry.path[i] = static_cast<uint8_t>(msg.ids[i]);
+    }
+    entry.value = std::move(msg.value);
+    entry.auth = std::move(msg.auth);
+    entry.value_digest = std::move(msg.value_digest);
+    seen_.set(rank);
+    count_++;
+  }
+
+  // Records the value as seen. Returns whether it had not been seen before.
+  bool SeeValue(const msg::Value& v) {
+    if (!values_seen_.insert(crypto::Hash(v)).second) {
+      return false;
+    }
+    if (values_seen_.size() == 1) {
+      first_value_ = v;
+    }
+    return true;
+  }
+};
+
+template <size_t N, size_t F>
+constexpr size_t FixedSignedMessages<N, F>::kRounds;
+template <size_t N, size_t F>
+constexpr size_t FixedSignedMessages<N, F>::kMaxMessages;
+template <size_t N, size_t F>
+constexpr std::array<size_t, FixedSignedMessages<N, F>::kRounds>
+    FixedSignedMessages<N, F>::kMessagesForRound;
+
+}  // namespace generals
+
+#endif
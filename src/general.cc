@@ -1,14 +1,12 @@
 #include "general.h"
 
-namespace generals {
+#include "readiness.h"
 
-size_t MessagesForRound(size_t process_num, unsigned int round) {
-  if (round == 0) return 1;
-  return (process_num - 1 - round) * MessagesForRound(process_num, round - 1);
-}
+namespace generals {
 
 std::experimental::optional<msg::Message> ByzantineMsgFromBuf(char* buf,
-                                                              size_t n) {
+                                                              size_t n,
+                                                              uint32_t* seq) {
   // Check to make sure the size of the buffer is correct.
   if (n < sizeof(msg::ByzantineMessage)) {
     return {};
@@ -18,7 +16,18 @@ std::experimental::optional<msg::Message> ByzantineMsgFromBuf(char* buf,
   msg::Message msg;
   msg::ByzantineMessage* c_msg = reinterpret_cast<msg::ByzantineMessage*>(buf);
   msg.round = ntohl(c_msg->round);
-  msg.order = static_cast<msg::Order>(ntohl(c_msg->order));
+  if (seq) *seq = ntohl(c_msg->seq);
+  auto order = static_cast<msg::Order>(ntohl(c_msg->order));
+  switch (order) {
+    case msg::Order::RETREAT:
+    case msg::Order::ATTACK:
+      msg.value = msg::OrderValue(order);
+      break;
+    case msg::Order::NO_ORDER:
+      break;
+    default:
+      return {};
+  }
 
   msg.ids.resize((n - sizeof(*c_msg)) / sizeof(uint32_t));
   uint32_t* id_buf = reinterpret_cast<uint32_t*>(buf + sizeof(*c_msg));
@@ -29,67 +38,415 @@ std::experimental::optional<msg::Message> ByzantineMsgFromBuf(char* buf,
   return msg;
 }
 
-std::experimental::optional<unsigned int> RoundOfAck(char* buf, size_t n) {
+std::experimental::optional<msg::Message> ValueMsgFromBuf(char* buf, size_t n,
+                                                          uint32_t* seq) {
   // Check to make sure the size of the buffer is correct.
-  if (n != sizeof(msg::Ack)) {
+  if (n < sizeof(msg::ValueMessage)) {
+    return {};
+  }
+
+  // Copy out the message part, making sure the ids and value fit in the buffer.
+  msg::Message msg;
+  msg::ValueMessage* c_msg = reinterpret_cast<msg::ValueMessage*>(buf);
+  msg.round = ntohl(c_msg->round);
+  if (seq) *seq = ntohl(c_msg->seq);
+  size_t id_count = ntohl(c_msg->id_count);
+  size_t value_size = ntohl(c_msg->value_size);
+  size_t avail = n - sizeof(*c_msg);
+  if (id_count > avail / sizeof(uint32_t)) {
+    return {};
+  }
+  avail -= id_count * sizeof(uint32_t);
+  if (value_size == kNoValue) {
+    value_size = 0;
+  } else if (value_size > kMaxValueSize) {
+    return {};
+  }
+  if (value_size != avail) {
+    return {};
+  }
+
+  msg.ids.resize(id_count);
+  uint32_t* id_buf = reinterpret_cast<uint32_t*>(buf + sizeof(*c_msg));
+  for (size_t i = 0; i < msg.ids.size(); ++i) {
+    msg.ids[i] = ntohl(id_buf[i]);
+  }
+  if (ntohl(c_msg->value_size) != kNoValue) {
+    msg.value = msg::Value(reinterpret_cast<char*>(id_buf + id_count),
+                           value_size);
+  }
+
+  return msg;
+}
+
+std::experimental::optional<msg::Message> AuthMsgFromBuf(char* buf, size_t n,
+                                                         uint32_t* seq) {
+  // Check to make sure the size of the buffer is correct.
+  if (n < sizeof(msg::AuthMessage)) {
+    return {};
+  }
+
+  // Copy out the message part, making sure the ids, value, digest and
+  // authenticators fit in the buffer exactly.
+  msg::Message msg;
+  msg::AuthMessage* c_msg = reinterpret_cast<msg::AuthMessage*>(buf);
+  msg.round = ntohl(c_msg->round);
+  if (seq) *seq = ntohl(c_msg->seq);
+  size_t id_count = ntohl(c_msg->id_count);
+  size_t value_size = ntohl(c_msg->value_size);
+  size_t digest_size = ntohl(c_msg->digest_size);
+  size_t auth_count = ntohl(c_msg->auth_count);
+  size_t auth_size = ntohl(c_msg->auth_size);
+  size_t avail = n - sizeof(*c_msg);
+  if (id_count > avail / sizeof(uint32_t)) {
+    return {};
+  }
+  avail -= id_count * sizeof(uint32_t);
+  if (value_size == kNoValue) {
+    value_size = 0;
+  } else if (value_size > kMaxValueSize) {
+    return {};
+  }
+  if (value_size > avail) {
+    return {};
+  }
+  avail -= value_size;
+  if (digest_size > avail) {
+    return {};
+  }
+  avail -= digest_size;
+  bool auth_fits = auth_size == 0 ? avail == 0
+                                  : avail % auth_size == 0 &&
+                                        avail / auth_size == auth_count;
+  if (!auth_fits) {
+    return {};
+  }
+
+  msg.ids.resize(id_count);
+  uint32_t* id_buf = reinterpret_cast<uint32_t*>(buf + sizeof(*c_msg));
+  for (size_t i = 0; i < msg.ids.size(); ++i) {
+    msg.ids[i] = ntohl(id_buf[i]);
+  }
+  char* value_buf = reinterpret_cast<char*>(id_buf + id_count);
+  if (ntohl(c_msg->value_size) != kNoValue) {
+    msg.value = msg::Value(value_buf, value_size);
+  }
+  char* digest_buf = value_buf + value_size;
+  msg.value_digest.assign(digest_buf, digest_size);
+  char* auth_buf = digest_buf + digest_size;
+  for (size_t i = 0; i < auth_count; ++i) {
+    msg.auth.emplace_back(auth_buf + i * auth_size, auth_size);
+  }
+
+  return msg;
+}
+
+std::experimental::optional<msg::Message> MsgFromBuf(char* buf, size_t n,
+                                                     uint32_t* seq) {
+  if (n < sizeof(uint32_t)) {
     return {};
   }
+  uint32_t type = ntohl(*reinterpret_cast<uint32_t*>(buf));
+  if (type == kValueMessageType) {
+    return ValueMsgFromBuf(buf, n, seq);
+  }
+  if (type == kAuthMessageType) {
+    return AuthMsgFromBuf(buf, n, seq);
+  }
+  return ByzantineMsgFromBuf(buf, n, seq);
+}
 
+std::experimental::optional<std::pair<AckId, AckTiming>> AckFromBuf(char* buf,
+                                                                   size_t n) {
+  // Check to make sure the size and type of the buffer are correct.
+  if (n != sizeof(msg::Ack)) {
+    return {};
+  }
   msg::Ack* ack = reinterpret_cast<msg::Ack*>(buf);
-  return ntohl(ack->round);
+  if (ntohl(ack->type) != kAckType) {
+    return {};
+  }
+
+  AckId id = {ntohl(ack->round), ntohl(ack->seq)};
+  return std::make_pair(id, ReadAckTiming(ack->hold_us, ack->elapsed_us));
+}
+
+namespace {
+
+// Sends the datagram with the provided id to the client up to attempts times,
+// until it is acknowledged, sampling the acknowledgement with skew and rtt if
+// provided. Returns whether it was acknowledged.
+bool SendUntilAck(udp::ClientPtr client, const char* buf, size_t n,
+                  const AckId& id, unsigned int attempts, RoundSkew* skew,
+                  LatencyHistogram* rtt) {
+  auto sent = std::chrono::steady_clock::now();
+
+  // Passed to SendWithAck to verify that any acknowledgement we hear is for
+  // this datagram, and not a late one for another.
+  auto isValidAck = [id, skew, rtt, sent](udp::ClientPtr client, char* buf,
+                                          size_t n) {
+    auto ack = AckFromBuf(buf, n);
+    bool valid = ack && ack->first == id;
+    if (!valid) return udp::ServerAction::Continue;
+    auto now = std::chrono::steady_clock::now();
+    if (skew) {
+      skew->Sample(client.get(), id.round, sent, now, ack->second);
+    }
+    if (rtt) {
+      rtt->Record(
+          std::chrono::duration_cast<std::chrono::microseconds>(now - sent));
+    }
+    return udp::ServerAction::Stop;
+  };
+
+  return client->SendWithAck(buf, n, attempts, isValidAck);
 }
 
-void SendMessage(udp::ClientPtr client, const msg::Message& msg) {
+// Encodes the message as a ByzantineMessage with the provided sequence number.
+// Its value must be an Order, if present.
+std::string EncodeByzantineMsg(const msg::Message& msg, uint32_t seq) {
   size_t size =
       sizeof(msg::ByzantineMessage) + sizeof(uint32_t) * msg.ids.size();
-  char buf[size];
-  bzero(buf, size);
+  std::string buf(size, '\0');
 
   // Copy the message part.
-  msg::ByzantineMessage* c_msg = reinterpret_cast<msg::ByzantineMessage*>(buf);
+  auto order = msg.value ? *msg::ValueOrder(*msg.value) : msg::Order::NO_ORDER;
+  msg::ByzantineMessage* c_msg =
+      reinterpret_cast<msg::ByzantineMessage*>(&buf[0]);
   c_msg->type = htonl(kByzantineMessageType);
   c_msg->size = htonl(size);
   c_msg->round = htonl(msg.round);
-  c_msg->order = htonl(static_cast<int>(msg.order));
+  c_msg->seq = htonl(seq);
+  c_msg->order = htonl(static_cast<int>(order));
 
   // C++ does not support flexible arrays, so we need to be a little tricky
   // here. We already made sure the buffer was the correct size by adding space
   // for each of the ids at the end of ByzantineMessage. Now we populate the
   // array.
-  uint32_t* id_buf = reinterpret_cast<uint32_t*>(buf + sizeof(*c_msg));
+  uint32_t* id_buf = reinterpret_cast<uint32_t*>(&buf[sizeof(*c_msg)]);
   for (size_t i = 0; i < msg.ids.size(); ++i) {
     id_buf[i] = htonl(msg.ids[i]);
   }
+  return buf;
+}
 
-  // Passed to SendWithAck to verify that any acknowledgement we hear is valid.
-  auto isValidAck = [msg](udp::ClientPtr _, char* buf, size_t n) {
-    auto ackRound = RoundOfAck(buf, n);
-    bool valid = ackRound && *ackRound == msg.round;
-    if (!valid) return udp::ServerAction::Continue;
-    return udp::ServerAction::Stop;
-  };
+// Encodes the message as a ValueMessage with the provided sequence number.
+std::string EncodeValueMsg(const msg::Message& msg, uint32_t seq) {
+  size_t value_size = msg.value ? msg.value->size() : 0;
+  size_t size = sizeof(msg::ValueMessage) +
+                sizeof(uint32_t) * msg.ids.size() + value_size;
+  std::string buf(size, '\0');
+
+  msg::ValueMessage* c_msg = reinterpret_cast<msg::ValueMessage*>(&buf[0]);
+  c_msg->type = htonl(kValueMessageType);
+  c_msg->size = htonl(size);
+  c_msg->round = htonl(msg.round);
+  c_msg->seq = htonl(seq);
+  c_msg->id_count = htonl(msg.ids.size());
+  c_msg->value_size = htonl(msg.value ? value_size : kNoValue);
+
+  // As above, populate the ids and then the value past the end of the struct.
+  uint32_t* id_buf = reinterpret_cast<uint32_t*>(&buf[sizeof(*c_msg)]);
+  for (size_t i = 0; i < msg.ids.size(); ++i) {
+    id_buf[i] = htonl(msg.ids[i]);
+  }
+  if (msg.value) {
+    msg.value->copy(reinterpret_cast<char*>(id_buf + msg.ids.size()),
+                    value_size);
+  }
+  return buf;
+}
 
-  client->SendWithAck(buf, size, kSendAttempts, isValidAck);
+// Encodes the message as an AuthMessage with the provided sequence number. All
+// of its authenticators must have the same size.
+std::string EncodeAuthMsg(const msg::Message& msg, uint32_t seq) {
+  size_t value_size = msg.value ? msg.value->size() : 0;
+  size_t auth_size = msg.auth.empty() ? 0 : msg.auth.front().size();
+  size_t size = sizeof(msg::AuthMessage) + sizeof(uint32_t) * msg.ids.size() +
+                value_size + msg.value_digest.size() +
+                auth_size * msg.auth.size();
+  std::string buf(size, '\0');
+
+  msg::AuthMessage* c_msg = reinterpret_cast<msg::AuthMessage*>(&buf[0]);
+  c_msg->type = htonl(kAuthMessageType);
+  c_msg->size = htonl(size);
+  c_msg->round = htonl(msg.round);
+  c_msg->seq = htonl(seq);
+  c_msg->id_count = htonl(msg.ids.size());
+  c_msg->value_size = htonl(msg.value ? value_size : kNoValue);
+  c_msg->digest_size = htonl(msg.value_digest.size());
+  c_msg->auth_count = htonl(msg.auth.size());
+  c_msg->auth_size = htonl(auth_size);
+
+  // As above, populate the ids, the value, the digest and then the
+  // authenticators past the end of the struct.
+  uint32_t* id_buf = reinterpret_cast<uint32_t*>(&buf[sizeof(*c_msg)]);
+  for (size_t i = 0; i < msg.ids.size(); ++i) {
+    id_buf[i] = htonl(msg.ids[i]);
+  }
+  char* value_buf = reinterpret_cast<char*>(id_buf + msg.ids.size());
+  if (msg.value) {
+    msg.value->copy(value_buf, value_size);
+  }
+  char* digest_buf = value_buf + value_size;
+  msg.value_digest.copy(digest_buf, msg.value_digest.size());
+  char* auth_buf = digest_buf + msg.value_digest.size();
+  for (auto const& auth : msg.auth) {
+    auth.copy(auth_buf, auth_size);
+    auth_buf += auth_size;
+  }
+  return buf;
+}
+
+}  // namespace
+
+bool SendMessage(udp::ClientPtr client, const msg::Message& msg, uint32_t seq,
+                 unsigned int attempts, RoundSkew* skew,
+                 LatencyHistogram* rtt) {
+  std::string buf;
+  if (!msg.auth.empty()) {
+    buf = EncodeAuthMsg(msg, seq);
+  } else if (!msg.value || msg::ValueOrder(*msg.value)) {
+    buf = EncodeByzantineMsg(msg, seq);
+  } else {
+    buf = EncodeValueMsg(msg, seq);
+  }
+  return SendUntilAck(client, buf.data(), buf.size(), {msg.round, seq},
+                      attempts, skew, rtt);
 }
 
-void SendAckForRound(udp::ClientPtr client, unsigned int round) {
+void SendAck(udp::ClientPtr client, const AckId& id, const AckTiming& timing) {
   msg::Ack ack = {};
   ack.type = htonl(kAckType);
   ack.size = htonl(sizeof(ack));
-  ack.round = htonl(round);
+  ack.round = htonl(id.round);
+  ack.seq = htonl(id.seq);
+  WriteAckTiming(timing, &ack.hold_us, &ack.elapsed_us);
 
   char* buf = reinterpret_cast<char*>(&ack);
   client->Send(buf, sizeof(ack));
 }
 
-UdpClientMap ClientsForProcessList(const ProcessList& processes) {
+std::experimental::optional<std::pair<unsigned int, unsigned int>> DoneFromBuf(
+    char* buf, size_t n) {
+  // Check to make sure the size of the buffer is correct.
+  if (n != sizeof(msg::Done)) {
+    return {};
+  }
+
+  msg::Done* done = reinterpret_cast<msg::Done*>(buf);
+  if (ntohl(done->type) != kDoneType) {
+    return {};
+  }
+  return std::make_pair(ntohl(done->round), ntohl(done->sender));
+}
+
+bool SendDone(udp::ClientPtr client, unsigned int round, unsigned int sender,
+              unsigned int attempts, RoundSkew* skew, LatencyHistogram* rtt) {
+  msg::Done done = {};
+  done.type = htonl(kDoneType);
+  done.size = htonl(sizeof(done));
+  done.round = htonl(round);
+  done.sender = htonl(sender);
+
+  char* buf = reinterpret_cast<char*>(&done);
+  return SendUntilAck(client, buf, sizeof(done), {round, kDoneSeq}, attempts,
+                      skew, rtt);
+}
+
+UdpClientMap ClientsForProcessList(const ProcessList& processes,
+                                   udp::LinkAuthPtr link_auth,
+                                   std::chrono::microseconds ack_timeout) {
   UdpClientMap clients(processes.size());
-  for (auto const& addr : processes) {
-    clients.emplace(addr, std::make_shared<udp::Client>(addr, kAckTimeout));
+  for (unsigned int pid = 0; pid < processes.size(); ++pid) {
+    auto const& addr = processes[pid];
+    if (link_auth) {
+      clients.emplace(addr, std::make_shared<udp::Client>(addr, ack_timeout,
+                                                          link_auth, pid));
+    } else {
+      clients.emplace(addr, std::make_shared<udp::Client>(addr, ack_timeout));
+    }
   }
   return clients;
 }
 
+bool SentBy(const ProcessList& processes, udp::ClientPtr client,
+            unsigned int pid) {
+  auto peer = client->Peer();
+  if (peer) {
+    return *peer == pid;
+  }
+  return processes.at(pid).hostname() == client->RemoteHostname();
+}
+
+std::ostream& operator<<(std::ostream& o, const RoundLatencies& l) {
+  o << "Round duration: " << l.round_duration.Summarize() << "\n";
+  o << "Time to first message: " << l.first_message.Summarize() << "\n";
+  o << "Time to round complete: " << l.round_complete.Summarize() << "\n";
+  o << "Ack round trip: " << l.ack_rtt.Summarize() << "\n";
+  return o << "Time to decision: " << l.decision.Summarize() << "\n";
+}
+
+void General::WriteTransportStats(std::ostream& o) const {
+  o << "{\"id\": " << id_ << ", \"server\": ";
+  auto server = ServerStats();
+  if (server) {
+    o << "{\"datagrams_received\": " << server->datagrams_received
+      << ", \"bytes_received\": " << server->bytes_received
+      << ", \"inauthentic\": " << server->inauthentic << "}";
+  } else {
+    o << "null";
+  }
+
+  o << ", \"peers\": [";
+  bool first = true;
+  for (size_t pid = 0; pid < peer_counters_.size(); ++pid) {
+    if (pid == id_) continue;
+    if (!first) o << ", ";
+    first = false;
+    auto const& counters = peer_counters_[pid];
+    if (pid < processes_.size()) {
+      auto client = ClientForId(pid)->Counts();
+      o << "{\"peer\": " << pid
+        << ", \"datagrams_sent\": " << client.datagrams_sent
+        << ", \"bytes_sent\": " << client.bytes_sent
+        << ", \"replies_received\": " << client.replies_received
+        << ", \"reply_bytes_received\": " << client.reply_bytes_received
+        << ", \"ack_timeouts\": " << client.ack_timeouts << ", ";
+    } else {
+      o << "{\"peer\": null, ";
+    }
+    o << "\"datagrams_received\": " << counters.datagrams_received
+      << ", \"bytes_received\": " << counters.bytes_received
+      << ", \"acks_sent\": " << counters.acks_sent
+      << ", \"retransmits\": " << counters.retransmits
+      << ", \"give_ups\": " << counters.give_ups
+      << ", \"duplicates\": " << counters.duplicates
+      << ", \"late\": " << counters.late << ", \"rejected\": {";
+    for (size_t r = 0; r < kRejections; ++r) {
+      if (r > 0) o << ", ";
+      o << "\"" << RejectionString(static_cast<Rejection>(r))
+        << "\": " << counters.rejected[r];
+    }
+    o << "}}";
+  }
+  o << "]}\n";
+}
+
+std::experimental::optional<unsigned int> General::Attribute(
+    udp::ClientPtr client,
+    std::experimental::optional<unsigned int> claimed) const {
+  auto peer = client->Peer();
+  if (peer) {
+    return peer;
+  }
+  if (claimed && *claimed < processes_.size() &&
+      SentBy(processes_, client, *claimed)) {
+    return claimed;
+  }
+  return {};
+}
+
 MaliciousBehavior StringToMaliciousBehavior(std::string str) {
   if (str == "silent") return MaliciousBehavior::SILENT;
   if (str == "delay_send") return MaliciousBehavior::DELAY_SEND;
@@ -115,11 +472,11 @@ std::string MaliciousBehaviorString(MaliciousBehavior m) {
   }
 }
 
-bool General::ShouldSendMsg() {
-  if (ExhibitsBehavior(MaliciousBehavior::SILENT)) {
+bool ShouldSendMsg(MaliciousBehavior b) {
+  if (Exhibits(b, MaliciousBehavior::SILENT)) {
     return false;
   }
-  if (ExhibitsBehavior(MaliciousBehavior::PARTIAL_SEND)) {
+  if (Exhibits(b, MaliciousBehavior::PARTIAL_SEND)) {
     // Send message 75% of the time.
     static thread_local std::default_random_engine random_engine(
         std::chrono::system_clock::now().time_since_epoch().count());
@@ -130,8 +487,8 @@ bool General::ShouldSendMsg() {
   return true;
 }
 
-void General::MaybeDelaySend() {
-  if (!ExhibitsBehavior(MaliciousBehavior::DELAY_SEND)) {
+void MaybeDelaySend(MaliciousBehavior b) {
+  if (!Exhibits(b, MaliciousBehavior::DELAY_SEND)) {
     return;
   }
 
@@ -154,243 +511,573 @@ void General::MaybeDelaySend() {
   return;
 }
 
-msg::Order Commander::Decide() {
-  // Send in parallel so that some Lieutenants don't end up far ahead of
-  // others.
-  threadutil::ThreadGroup senders;
+msg::Value ValueForMsg(MaliciousBehavior b, const msg::Value& value) {
+  if (Exhibits(b, MaliciousBehavior::WRONG_ORDER)) {
+    // Send wrong value 30% of the time.
+    static thread_local std::default_random_engine random_engine(
+        std::chrono::system_clock::now().time_since_epoch().count());
+
+    std::uniform_real_distribution<double> distribution(0.0, 1.0);
+    if (distribution(random_engine) < 0.30) {
+      auto order = msg::ValueOrder(value);
+      if (order) {
+        return msg::OrderValue(*order == msg::Order::ATTACK
+                                   ? msg::Order::RETREAT
+                                   : msg::Order::ATTACK);
+      }
+      if (value.empty()) {
+        return msg::Value(1, '\xff');
+      }
+      msg::Value wrong = value;
+      wrong.back() ^= 0xff;
+      return wrong;
+    }
+  }
+  return value;
+}
+
+Commander::~Commander() {
+  StopSending();
+  if (delivery_.joinable()) delivery_.join();
+}
+
+msg::Value Commander::Decide() {
+  auto decision = DecideAsync();
+  decision.delivery.wait();
+  return decision.value;
+}
+
+AsyncDecision Commander::DecideAsync(
+    std::experimental::optional<std::chrono::microseconds> deadline) {
+  auto start = std::chrono::steady_clock::now();
+  tracing::trace.Record(tracing::EventType::DECIDE, tracing::kNoPeer, round_);
+  std::promise<Delivery> promise;
+  AsyncDecision decision{value_, promise.get_future()};
+  delivery_ = std::thread(
+      [this, start, deadline, promise = std::move(promise)]() mutable {
+        Deliver(start, deadline, std::move(promise));
+      });
+  return decision;
+}
+
+void Commander::Deliver(
+    std::chrono::steady_clock::time_point start,
+    std::experimental::optional<std::chrono::microseconds> deadline,
+    std::promise<Delivery> promise) {
+  // Every loyal Lieutenant answers once it listens, while faulty ones may not.
+  WaitForReady(processes_, 0, processes_.size() - 1 - faulty_, link_auth_);
+
+  std::vector<std::pair<unsigned int, msg::Message>> orders;
   auto ids = std::vector<unsigned int>{0};
   for (unsigned int pid = 1; pid < processes_.size(); ++pid) {
     if (ShouldSendMsg()) {
-      msg::Message msg{round_, OrderForMsg(), ids};
-      logging::out << "Sending  " << msg << " to p" << pid << "\n";
+      msg::Message msg{round_, ValueForMsg(), ids};
+      if (auth_) auth_->Sign(msg, 0);
+      LOG(DEBUG) << "Sending  " << msg << " to p" << pid << "\n";
+      orders.emplace_back(pid, msg);
+    }
+  }
 
-      udp::ClientPtr client = ClientForId(pid);
-      senders.AddThread([this, client, msg] {
-        MaybeDelaySend();
-        SendMessage(client, msg);
+  // Send in parallel so that some Lieutenants don't end up far ahead of
+  // others, one attempt at a time so that sending can stop between attempts.
+  std::mutex mu;
+  std::condition_variable changed;
+  size_t pending = orders.size();
+  size_t acknowledged = 0;
+  threadutil::ThreadGroup senders;
+  for (auto const& order : orders) {
+    udp::ClientPtr client = ClientForId(order.first);
+    auto msg = order.second;
+    senders.AddThread([&, client, msg] {
+      MaybeDelaySend();
+      // Each Lieutenant is sent a single order, the first message of the round.
+      AckId id = {msg.round, 0};
+      bool acked = AttemptUntilStopped(order.first, id, [&](unsigned int i) {
+        auto rtt = i == 0 ? &latencies_.ack_rtt : nullptr;
+        return SendMessage(client, msg, id.seq, 1, nullptr, rtt);
       });
+      std::lock_guard<std::mutex> lock(mu);
+      pending--;
+      if (acked) acknowledged++;
+      changed.notify_one();
+    });
+  }
+
+  Delivery delivery;
+  delivery.sent = orders.size();
+  {
+    std::unique_lock<std::mutex> lock(mu);
+    auto done = [&pending] { return pending == 0; };
+    if (deadline) {
+      delivery.finished = changed.wait_until(lock, start + *deadline, done);
+    } else {
+      changed.wait(lock, done);
+      delivery.finished = true;
     }
+    delivery.acknowledged = acknowledged;
   }
+  delivery.took = std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - start);
+
+  // Give up on the orders that are still unacknowledged past the deadline.
+  StopSending();
+  LOG(INFO) << "Delivered orders to " << delivery.acknowledged << " of "
+            << delivery.sent << " Lieutenants after "
+            << delivery.took.count() << "us"
+            << (delivery.finished ? "" : ", giving up on the others")
+            << "\n";
+  promise.set_value(delivery);
+
   senders.JoinAll();
-  return order_;
+  LogAuthStats();
 }
 
-msg::Order Commander::OrderForMsg() const {
-  if (ExhibitsBehavior(MaliciousBehavior::WRONG_ORDER)) {
-    // Send wrong order 30% of the time.
-    static thread_local std::default_random_engine random_engine(
-        std::chrono::system_clock::now().time_since_epoch().count());
-
-    std::uniform_real_distribution<double> distribution(0.0, 1.0);
-    if (distribution(random_engine) < 0.30) {
-      return order_ == msg::Order::ATTACK ? msg::Order::RETREAT
-                                          : msg::Order::ATTACK;
-    }
-  }
-  return order_;
+msg::Value Commander::ValueForMsg() const {
+  return generals::ValueForMsg(behavior_, value_);
 }
 
-msg::Order Lieutenant::Decide() {
+msg::Value Lieutenant::Decide() {
+  auto start = std::chrono::steady_clock::now();
+  tracing::trace.Record(tracing::EventType::ROUND_START, tracing::kNoPeer,
+                        round_);
   server_.Listen(
       // Called on all incoming Byzantine Messages.
       [this](udp::ClientPtr client, char* buf, size_t n) {
-        auto from = client->RemoteAddress();
-        auto msg = ByzantineMsgFromBuf(buf, n);
-        if (!msg || !ValidMessage(*msg, from)) {
-          // If the message was not valid, return without trying to use it.
-          return ContinueUnlessTimeout();
+        auto received = std::chrono::steady_clock::now();
+        AlignDeadline();
+
+        // Never decode datagrams that failed link authentication, and answer
+        // the Commander right away if it is checking that we listen.
+        if (!client->Authentic() || AnswerHello(client, buf, n, id_)) {
+          return udp::ServerAction::Continue;
         }
 
-        logging::out << "Received " << *msg << " from p" << msg->ids.back()
-                     << "\n";
-        SendAckForRound(client, round_);
-
-        bool newRound = false;
-        if (FirstRound()) {
-          // Only handle the first real order.
-          if (msg->order != msg::Order::NO_ORDER && orders_seen_.size() == 0) {
-            orders_seen_.insert(msg->order);
-            msgs_this_round_.insert(*msg);
-            newRound = true;
-          }
-        } else {
-          // Handle if not a replay of a previous message (msg with same ids).
-          if (ids_this_round_.count(msg->ids) == 0) {
-            ids_this_round_.insert(msg->ids);
-
-            // Handle the order in the message based on if we've seen the same
-            // order or not.
-            if (msg->order != msg::Order::NO_ORDER &&
-                orders_seen_.count(msg->order) == 0) {
-              // We have not seen this order yet, so we add it to the
-              // orders_seen set and forward it in the next round.
-              orders_seen_.insert(msg->order);
-            } else {
-              // We have already seen this order, so we forward a no_order
-              // instead next round.
-              msg->order = msg::Order::NO_ORDER;
-            }
-
-            // Record the message so we can forward it next round.
-            msgs_this_round_.insert(*msg);
-
-            // Determine if this is the last message needed for the round.
-            newRound = RoundComplete();
+        auto done = DoneFromBuf(buf, n);
+        if (done) {
+          return HandleDone(client, done->first, done->second, n, received);
+        }
+
+        // If the message was not valid, return without trying to use it.
+        uint32_t seq = 0;
+        auto msg = MsgFromBuf(buf, n, &seq);
+        if (!msg) {
+          CountRejected(client, {}, Rejection::MALFORMED);
+          return udp::ServerAction::Continue;
+        }
+        auto rejection = CheckMessage(*msg, client);
+        if (rejection) {
+          std::experimental::optional<unsigned int> claimed;
+          if (!msg->ids.empty()) claimed = msg->ids.back();
+          CountRejected(client, claimed, *rejection);
+          return udp::ServerAction::Continue;
+        }
+        unsigned int sender = msg->ids.back();
+        auto& stats = peer_counters_[sender];
+        stats.datagrams_received++;
+        stats.bytes_received += n;
+        tracing::trace.Record(tracing::EventType::RECEIVE, sender, msg->round,
+                              seq);
+
+        if (Early(msg->round)) {
+          if (BufferForRound(client, {msg->round, seq}, sender, received)) {
+            LOG(DEBUG) << "Buffered " << *msg << " from p" << sender << "\n";
+            future_msgs_.emplace(msg->round, std::make_pair(seq, *msg));
           }
+          return udp::ServerAction::Continue;
         }
 
+        LOG(DEBUG) << "Received " << *msg << " from p" << sender << "\n";
+        SendAck(client, {msg->round, seq},
+                TimingForAckOf(msg->round, received));
+        stats.acks_sent++;
+        NoteArrival(msg->round);
+
+        // Messages from earlier rounds arrived too late to be relayed in the
+        // round after them, so like in the engine they are of no use anymore.
+        if (msg->round != round_) {
+          stats.late++;
+          return udp::ServerAction::Continue;
+        }
+
+        NoteSeen(sender, seq);
+        bool newRound = protocol_->Receive(*msg, round_);
         if (newRound) {
           return MoveToNewRoundOrStop();
         }
-        return ContinueUnlessTimeout();
+        return udp::ServerAction::Continue;
       },
-      // Called on socket timeout.
+      // Called once the round deadline passes.
       [this]() { return HandleRoundTimeout(); });
 
-  return DecideOrder();
+  auto decision = protocol_->Decide();
+  tracing::trace.Record(tracing::EventType::DECIDE, tracing::kNoPeer, round_);
+  latencies_.decision.Record(
+      std::chrono::duration_cast<std::chrono::microseconds>(
+          std::chrono::steady_clock::now() - start));
+  return decision;
 }
 
-inline msg::Order Lieutenant::DecideOrder() const {
-  if (orders_seen_.size() == 1 && orders_seen_.count(msg::Order::ATTACK) == 1) {
-    return msg::Order::ATTACK;
+udp::ServerAction Lieutenant::HandleDone(
+    udp::ClientPtr client, unsigned int round, unsigned int sender, size_t n,
+    std::chrono::steady_clock::time_point received) {
+  // Invalid if the marker is from after the last round or not from a
+  // Lieutenant.
+  if (round > last_round_) {
+    CountRejected(client, sender, Rejection::ROUND);
+    return udp::ServerAction::Continue;
   }
-  return msg::Order::RETREAT;
-}
+  if (!ValidSender(sender, client)) {
+    CountRejected(client, sender, Rejection::SENDER);
+    return udp::ServerAction::Continue;
+  }
+  auto& stats = peer_counters_[sender];
+  stats.datagrams_received++;
+  stats.bytes_received += n;
+  tracing::trace.Record(tracing::EventType::RECEIVE, sender, round, kDoneSeq);
 
-inline bool Lieutenant::RoundComplete() const {
-  return ids_this_round_.size() == MessagesForRound(processes_.size(), round_);
-}
+  if (Early(round)) {
+    if (BufferForRound(client, {round, kDoneSeq}, sender, received)) {
+      LOG(DEBUG) << "Buffered done for round " << round << " from p"
+                 << sender << "\n";
+      future_done_.emplace(round, sender);
+    }
+    return udp::ServerAction::Continue;
+  }
 
-udp::ServerAction Lieutenant::ContinueUnlessTimeout() {
-  // Compute the duration between the start of the round and now.
-  const auto now = std::chrono::steady_clock::now();
-  const auto round_dur = std::chrono::duration_cast<std::chrono::microseconds>(
-      now - round_start_ts_);
+  LOG(DEBUG) << "Received done for round " << round << " from p" << sender
+             << "\n";
+  SendAck(client, {round, kDoneSeq}, TimingForAckOf(round, received));
+  stats.acks_sent++;
+  NoteArrival(round);
 
-  // If this duration is more than the round timeout, handle the timeout.
-  if (round_dur > kRoundTimeout) {
-    HandleRoundTimeout();
+  // Markers from previous rounds are acknowledged, but of no use anymore.
+  if (round != round_) {
+    stats.late++;
+    return udp::ServerAction::Continue;
+  }
+  NoteSeen(sender, kDoneSeq);
+  if (protocol_->ReceiveDone(sender, round_)) {
+    return MoveToNewRoundOrStop();
   }
   return udp::ServerAction::Continue;
 }
 
 udp::ServerAction Lieutenant::HandleRoundTimeout() {
+  // The timer also fires once the round is prepared.
+  if (transitioning_) {
+    return StartRoundIfPrepared();
+  }
   if (FirstRound()) {
     // We can't timeout in the first round. Just continue to wait.
     return udp::ServerAction::Continue;
   }
 
-  logging::out << "Timeout in round " << round_ << "\n";
+  // The deadline may have moved later since it was armed.
+  AlignDeadline();
+  if (std::chrono::steady_clock::now() < deadline_ts_) {
+    return udp::ServerAction::Continue;
+  }
+
+  LOG(INFO) << "Timeout in round " << round_ << "\n";
   return MoveToNewRoundOrStop();
 }
 
 udp::ServerAction Lieutenant::MoveToNewRoundOrStop() {
-  if (LastRound()) {
-    ClearSenders();
-    return udp::ServerAction::Stop;
+  tracing::trace.Record(tracing::EventType::ROUND_END, tracing::kNoPeer, round_,
+                        0, protocol_->RoundComplete(round_));
+  if (!LastRound()) {
+    BeginRound();
+    return udp::ServerAction::Continue;
   }
-  InitNewRound();
-  return udp::ServerAction::Continue;
+  // The decision is known, so the last relays are left to Drain.
+  EndRound();
+  LogAuthStats();
+  return udp::ServerAction::Stop;
 }
 
-void Lieutenant::ClearSenders() {
-  sender_threads_this_round_.JoinAll();
-  sender_threads_this_round_.Clear();
+AckTiming Lieutenant::TimingForAckOf(
+    unsigned int round, std::chrono::steady_clock::time_point received) const {
+  std::experimental::optional<std::chrono::steady_clock::time_point> start;
+  if (round == round_ && !FirstRound() && !transitioning_) {
+    start = round_start_ts_;
+  }
+  return TimingForAck(received, start);
+}
+
+void Lieutenant::AlignDeadline() {
+  if (FirstRound() || transitioning_) {
+    return;
+  }
+  auto aligned = round_start_ts_ + deadline_.Current() +
+                 skew_.Offset(deadline_.Current() / kMaxSkewFraction);
+  if (aligned != deadline_ts_) {
+    deadline_ts_ = aligned;
+    server_.SetDeadline(deadline_ts_);
+  }
 }
 
-void Lieutenant::InitNewRound() {
+void Lieutenant::NoteArrival(unsigned int round) {
+  if (FirstRound() || transitioning_) {
+    return;
+  }
+  if (round < round_) {
+    late_this_round_ = true;
+    return;
+  }
+  auto arrival = std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - round_start_ts_);
+  if (!last_arrival_) {
+    latencies_.first_message.Record(arrival);
+  }
+  last_arrival_ = arrival;
+}
+
+void Lieutenant::EndRound() {
+  // The first round has no start to measure from.
+  if (FirstRound()) {
+    return;
+  }
+
+  auto duration = std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - round_start_ts_);
+  latencies_.round_duration.Record(duration);
+  if (protocol_->RoundComplete(round_)) {
+    latencies_.round_complete.Record(duration);
+  }
+
+  LOG(INFO) << "Round " << round_ << " deadline was "
+            << deadline_.Current().count() << "us";
+  auto shift = std::chrono::duration_cast<std::chrono::microseconds>(
+      deadline_ts_ - round_start_ts_ - deadline_.Current());
+  if (shift.count() != 0) {
+    LOG(INFO) << ", aligned by " << shift.count() << "us";
+  }
+  if (late_this_round_) {
+    LOG(INFO) << ", messages from earlier rounds arrived late\n";
+    deadline_.Backoff();
+  } else if (last_arrival_) {
+    LOG(INFO) << ", last message arrived after " << last_arrival_->count()
+              << "us\n";
+    deadline_.Record(*last_arrival_);
+  } else {
+    LOG(INFO) << ", no messages arrived\n";
+  }
+}
+
+Lieutenant::~Lieutenant() {
+  StopSending();
+  if (transition_.joinable()) transition_.join();
   ClearSenders();
-  IncrementRound();
+}
 
-  // Determine the set of messages to forward in the next round.
-  std::unordered_map<unsigned int, std::vector<msg::Message>> toSend;
-  for (msg::Message msg : msgs_this_round_) {
-    if (msg.round != round_ - 1) {
-      throw std::logic_error(
-          "message in msgs_this_round_ not from current round");
+void Lieutenant::Drain(
+    std::experimental::optional<std::chrono::microseconds> deadline) {
+  auto start = std::chrono::steady_clock::now();
+  size_t running;
+  {
+    std::unique_lock<std::mutex> lock(senders_mu_);
+    auto idle = [this] { return senders_running_ == 0; };
+    if (deadline) {
+      senders_idle_.wait_until(lock, start + *deadline, idle);
+    } else {
+      senders_idle_.wait(lock, idle);
     }
+    running = senders_running_;
+  }
+  auto took = std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - start);
 
-    // Update the messages round number to the current round.
-    msg.round = round_;
+  // Give up on the relays that are still unacknowledged past the deadline.
+  StopSending();
+  ClearSenders();
+  LOG(INFO) << "Drained the last round after " << took.count() << "us";
+  if (running > 0) {
+    LOG(INFO) << ", giving up on the senders still running: " << running;
+  }
+  LOG(INFO) << "\n";
+}
 
-    // Add this process in at the end of the message id list.
-    msg.ids.push_back(id_);
+void Lieutenant::ClearSenders() {
+  sender_threads_this_round_.JoinAll();
+  sender_threads_this_round_.Clear();
+}
 
-    // Determine which processes we need to send this message to.
-    for (unsigned int pid = 0; pid < processes_.size(); ++pid) {
-      // Only send to processes not already in this message.
-      bool inMsg = false;
-      for (auto const& id : msg.ids) {
-        if (id == pid) {
-          inMsg = true;
-          break;
-        }
-      }
-      if (!inMsg) {
-        if (ShouldSendMsg()) {
-          logging::out << "Sending  " << msg << " to p" << pid << "\n";
-          toSend[pid].push_back(msg);
-        }
+void Lieutenant::BeginRound() {
+  EndRound();
+  LogAuthStats();
+  if (auth_) auth_->EndRound();
+  IncrementRound();
+  transitioning_ = true;
+  transition_ = std::thread([this] { PrepareRound(); });
+}
+
+void Lieutenant::PrepareRound() {
+  // The senders of the previous round share their clients with those of this
+  // one, so they have to be done first.
+  ClearSenders();
+
+  // Determine the set of messages to send in the next round. When sending done
+  // markers, processes without messages still need to be marked done.
+  bool send_done = spec_.SendsDone();
+  Outbox outbox = protocol_->NextRound(round_);
+  if (auth_) auth_->SignOutbox(outbox, 0);
+  Outbox toSend;
+  for (auto const& batch : outbox) {
+    if (send_done) toSend[batch.first];
+    for (auto const& msg : batch.second) {
+      if (ShouldSendMsg()) {
+        LOG(DEBUG) << "Sending  " << msg << " to p" << batch.first << "\n";
+        toSend[batch.first].push_back(msg);
       }
     }
   }
 
   // For each process that we have messages to send to...
   for (auto const& batch : toSend) {
-    sender_threads_this_round_.AddThread([this, batch] {
-      // Send each message to the process serially in a new thread.
+    bool done = send_done && ShouldSendMsg();
+    unsigned int round = round_;
+    {
+      std::lock_guard<std::mutex> lock(senders_mu_);
+      senders_running_++;
+    }
+    sender_threads_this_round_.AddThread([this, batch, done, round] {
+      // Send each message to the process serially in a new thread, followed
+      // by the done marker. Only first attempts sample the skew and round
+      // trips, since a retransmission may hear the acknowledgement of an
+      // earlier attempt (see AttemptUntilStopped).
       unsigned int pid = batch.first;
       udp::ClientPtr client = ClientForId(pid);
-      for (auto const& msg : batch.second) {
+      auto& rtt = latencies_.ack_rtt;
+      for (uint32_t seq = 0; seq < batch.second.size(); ++seq) {
+        auto const& msg = batch.second[seq];
         MaybeDelaySend();
-        SendMessage(client, msg);
+        AttemptUntilStopped(pid, {msg.round, seq}, [&](unsigned int i) {
+          if (i > 0) return SendMessage(client, msg, seq, 1);
+          return SendMessage(client, msg, seq, 1, &skew_, &rtt);
+        });
+      }
+      if (done) {
+        AttemptUntilStopped(pid, {round, kDoneSeq}, [&](unsigned int i) {
+          if (i > 0) return SendDone(client, round, id_, 1);
+          return SendDone(client, round, id_, 1, &skew_, &rtt);
+        });
       }
+
+      std::lock_guard<std::mutex> lock(senders_mu_);
+      if (--senders_running_ == 0) senders_idle_.notify_all();
     });
   }
 
-  // Clear round-specific containers and reset round start timestamp.
-  ids_this_round_.clear();
-  msgs_this_round_.clear();
+  std::lock_guard<std::mutex> lock(transition_mu_);
+  transition_ready_ = true;
+  server_.SetDeadline(std::chrono::steady_clock::now());
+}
+
+udp::ServerAction Lieutenant::StartRoundIfPrepared() {
+  // The server was woken up by a deadline of the previous round.
+  {
+    std::lock_guard<std::mutex> lock(transition_mu_);
+    if (!transition_ready_) {
+      return udp::ServerAction::Continue;
+    }
+    transition_ready_ = false;
+  }
+  transition_.join();
+  transitioning_ = false;
+
+  // Reset per-round state and the round start timestamp, and arm the round
+  // deadline.
+  last_arrival_ = {};
+  late_this_round_ = false;
+  seen_this_round_.clear();
   round_start_ts_ = std::chrono::steady_clock::now();
+  tracing::trace.Record(tracing::EventType::ROUND_START, tracing::kNoPeer,
+                        round_);
+  skew_.StartRound(round_, round_start_ts_);
+  deadline_ts_ = round_start_ts_ + deadline_.Current();
+  server_.SetDeadline(deadline_ts_);
+
+  ReplayBuffered();
+  if (protocol_->RoundComplete(round_)) {
+    return MoveToNewRoundOrStop();
+  }
+  return udp::ServerAction::Continue;
 }
 
-bool Lieutenant::ValidMessage(const msg::Message& msg,
-                              const net::Address& from) const {
-  // Invalid if the message is from a later round.
-  if (msg.round > round_) {
+bool Lieutenant::BufferForRound(
+    udp::ClientPtr client, const AckId& id, unsigned int sender,
+    std::chrono::steady_clock::time_point received) {
+  if (buffered_per_sender_[sender] >= kMaxBufferedMessages) {
     return false;
   }
-  // Invalid if the message has an incorrect number of ids.
-  if (msg.round + 1 != msg.ids.size()) {
-    return false;
+  SendAck(client, id, TimingForAck(received, {}));
+  peer_counters_[sender].acks_sent++;
+  buffered_per_sender_[sender]++;
+  return true;
+}
+
+void Lieutenant::ReplayBuffered() {
+  auto early = future_msgs_.equal_range(round_);
+  for (auto it = early.first; it != early.second; ++it) {
+    auto const& msg = it->second.second;
+    NoteSeen(msg.ids.back(), it->second.first);
+    protocol_->Receive(msg, round_);
+    buffered_per_sender_[msg.ids.back()]--;
   }
-  // Invalid if the first message is not from the General (pid 0);
-  if (msg.ids.at(0) != 0) {
-    return false;
+  future_msgs_.erase(early.first, early.second);
+
+  auto early_done = future_done_.equal_range(round_);
+  for (auto it = early_done.first; it != early_done.second; ++it) {
+    NoteSeen(it->second, kDoneSeq);
+    protocol_->ReceiveDone(it->second, round_);
+    buffered_per_sender_[it->second]--;
   }
-  // Invalid if not all ids are unique.
-  std::set<unsigned int> idset;
-  for (auto const& id : msg.ids) {
-    // Invalid if any id is out of bounds.
-    if (id >= processes_.size()) {
-      return false;
-    }
-    // Invalid if any id is our id.
-    if (id == id_) {
-      return false;
-    }
-    idset.insert(id);
+  future_done_.erase(early_done.first, early_done.second);
+}
+
+void Lieutenant::NoteSeen(unsigned int sender, uint32_t seq) {
+  if (!seen_this_round_.emplace(sender, seq).second) {
+    peer_counters_[sender].duplicates++;
   }
-  if (idset.size() < msg.ids.size()) {
-    return false;
+}
+
+void Lieutenant::CountRejected(
+    udp::ClientPtr client, std::experimental::optional<unsigned int> claimed,
+    Rejection reason) const {
+  auto peer = Attribute(client, claimed);
+  CountersFor(peer).Reject(reason);
+  tracing::trace.Record(tracing::EventType::REJECT,
+                        peer ? *peer : tracing::kNoPeer, round_, 0,
+                        static_cast<uint32_t>(reason));
+}
+
+std::experimental::optional<Rejection> Lieutenant::CheckMessage(
+    const msg::Message& msg, udp::ClientPtr client) const {
+  // Invalid if the message is from after the last round.
+  if (msg.round > last_round_) {
+    return Rejection::ROUND;
+  }
+  // Invalid if the protocol does not expect the message.
+  if (!protocol_->ValidMessage(msg, msg.round)) {
+    return Rejection::PATH;
+  }
+  // Invalid if the last id does not match the sender.
+  if (!SentBy(processes_, client, msg.ids.back())) {
+    return Rejection::SENDER;
   }
-  // Invalid if the last id does not match the sender. This check will not
-  // be complete for processes on the same host, because we can not know the
-  // sending port of the process, only its receiving port.
-  if (processes_.at(msg.ids.back()).hostname() != from.hostname()) {
+  // Invalid if any hop of the message is not authentic.
+  if (auth_ && !auth_->Verify(msg, 0)) {
+    return Rejection::AUTH;
+  }
+  return {};
+}
+
+bool Lieutenant::ValidSender(unsigned int sender,
+                             udp::ClientPtr client) const {
+  if (sender == 0 || sender == id_ || sender >= processes_.size()) {
     return false;
   }
-  return true;
+  return SentBy(processes_, client, sender);
 }
 
 }  // namespace generals
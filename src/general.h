@@ -1,49 +1,149 @@
 #ifndef GENERAL_H_
 #define GENERAL_H_
 
+#include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <condition_variable>
 #include <exception>
 #include <experimental/optional>
+#include <future>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <random>
 #include <set>
 #include <string>
 #include <thread>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
+#include "auth.h"
+#include "deadline.h"
+#include "histogram.h"
 #include "log.h"
 #include "message.h"
 #include "net.h"
+#include "peer_counters.h"
+#include "protocol.h"
+#include "round_skew.h"
 #include "thread.h"
+#include "trace.h"
 #include "udp_conn.h"
 
 namespace generals {
 
 const auto kAckTimeout = std::chrono::milliseconds{250};
+// The default bounds of the adaptive round deadlines (see RoundDeadline). The
+// lower bound is raised to fit every send attempt (see MinRoundTimeout).
+const auto kMinRoundTimeout = std::chrono::milliseconds{10};
 const auto kRoundTimeout = std::chrono::seconds{1};
 const unsigned int kSendAttempts = 3;
 
-// Determines the maximum number of valid messages that a Lieutenant process
-// should expect in a certain round given a number of initial processes.
-size_t MessagesForRound(size_t process_num, unsigned int round);
+// How long a process waits for the acknowledgement of a datagram before sending
+// it again, and how many times it sends it before giving up. Either the lab
+// defaults, or measured at startup (see Calibrate).
+struct AckPolicy {
+  std::chrono::microseconds timeout;
+  unsigned int attempts;
+};
+const AckPolicy kDefaultAckPolicy = {kAckTimeout, kSendAttempts};
+
+// Returns the shortest round deadline under the ack policy. A loyal message
+// lost on its first attempts is only resent after each ack timeout, so a round
+// must last every attempt for such a message to arrive before its end, rather
+// than be dropped as late.
+inline std::chrono::microseconds MinRoundTimeout(const AckPolicy& ack) {
+  return std::max<std::chrono::microseconds>(kMinRoundTimeout,
+                                             ack.timeout * ack.attempts);
+}
+
+// The maximum number of messages and done markers from a single process that a
+// Lieutenant will buffer for later rounds. Bounds the memory a faulty process
+// can consume.
+const size_t kMaxBufferedMessages = 4096;
 
 // Decodes a msg::Message from the provided buffer. If the decoding is
 // successful, the optional return value will be present. If not, the return
-// value will be absent.
-std::experimental::optional<msg::Message> ByzantineMsgFromBuf(char* buf,
-                                                              size_t n);
+// value will be absent. If seq is provided, it is set to the sequence number of
+// the message (see AckId).
+std::experimental::optional<msg::Message> ByzantineMsgFromBuf(
+    char* buf, size_t n, uint32_t* seq = nullptr);
 
-// Decodes a msg::Ack from the provided buffer and returns its round number. If
+// Decodes a msg::Message from the provided buffer holding a ValueMessage. If
 // the decoding is successful, the optional return value will be present. If
-// not, the return value will be absent.
-std::experimental::optional<unsigned int> RoundOfAck(char* buf, size_t n);
+// not, the return value will be absent. If seq is provided, it is set to the
+// sequence number of the message.
+std::experimental::optional<msg::Message> ValueMsgFromBuf(
+    char* buf, size_t n, uint32_t* seq = nullptr);
 
-// Sends the message to the client.
-void SendMessage(udp::ClientPtr client, const msg::Message& msg);
+// Decodes a msg::Message from the provided buffer holding an AuthMessage. If
+// the decoding is successful, the optional return value will be present. If
+// not, the return value will be absent. If seq is provided, it is set to the
+// sequence number of the message.
+std::experimental::optional<msg::Message> AuthMsgFromBuf(
+    char* buf, size_t n, uint32_t* seq = nullptr);
+
+// Decodes a msg::Message from the provided buffer holding a ByzantineMessage,
+// a ValueMessage or an AuthMessage, depending on its type. If seq is provided,
+// it is set to the sequence number of the message.
+std::experimental::optional<msg::Message> MsgFromBuf(char* buf, size_t n,
+                                                     uint32_t* seq = nullptr);
+
+// The sequence number of a done marker, in acknowledgements. No message has it,
+// since a process never sends another one that many messages in a round.
+const uint32_t kDoneSeq = 0xffffffff;
+
+// Identifies the datagram an acknowledgement is for: its round, and the
+// sequence number of the message it holds, or kDoneSeq for a done marker. The
+// sequence number of a message is its position among the messages its sender
+// sends the receiver in the round, carried in the message itself, so the pair
+// tells apart every datagram a process sends to another one exactly, and
+// stays the same across retransmissions.
+struct AckId {
+  unsigned int round;
+  uint32_t seq;
+
+  inline bool operator==(const AckId& other) const {
+    return round == other.round && seq == other.seq;
+  }
+};
 
-// Sends an acknowledgement for the provided round to the client.
-void SendAckForRound(udp::ClientPtr client, unsigned int round);
+// Decodes a msg::Ack from the provided buffer and returns the id of the
+// datagram it acknowledges, and its timing. If the decoding is successful, the
+// optional return value will be present. If not, the return value will be
+// absent.
+std::experimental::optional<std::pair<AckId, AckTiming>> AckFromBuf(char* buf,
+                                                                   size_t n);
+
+// Sends the message to the client with the provided sequence number (see
+// AckId). Messages with authenticators are sent as an AuthMessage. Of the
+// others, messages whose value is an Order (or that carry no value) are sent as
+// a ByzantineMessage, all others as a ValueMessage. The message is sent up to
+// attempts times. If skew is provided, the
+// acknowledgement is sampled by it, and if rtt is provided, the time from the
+// attempt to its acknowledgement is recorded in it. Returns whether the message
+// was acknowledged.
+bool SendMessage(udp::ClientPtr client, const msg::Message& msg, uint32_t seq,
+                 unsigned int attempts, RoundSkew* skew = nullptr,
+                 LatencyHistogram* rtt = nullptr);
+
+// Sends an acknowledgement of the datagram with the provided id to the client.
+void SendAck(udp::ClientPtr client, const AckId& id, const AckTiming& timing);
+
+// Decodes a msg::Done from the provided buffer and returns its round number and
+// sender. If the decoding is successful, the optional return value will be
+// present. If not, the return value will be absent.
+std::experimental::optional<std::pair<unsigned int, unsigned int>> DoneFromBuf(
+    char* buf, size_t n);
+
+// Sends a marker to the client saying that the sender is done with the round,
+// up to attempts times. The acknowledgement is sampled by skew and rtt like in
+// SendMessage. Returns whether the marker was acknowledged.
+bool SendDone(udp::ClientPtr client, unsigned int round, unsigned int sender,
+              unsigned int attempts, RoundSkew* skew = nullptr,
+              LatencyHistogram* rtt = nullptr);
 
 // Holds a list of processes participating in the agreement algorithm.
 typedef std::vector<net::Address> ProcessList;
@@ -53,8 +153,20 @@ typedef std::unordered_map<net::Address, udp::ClientPtr, net::AHash>
     UdpClientMap;
 
 // Creates a mapping from network addresses to UDP clients, populated with each
-// process provided.
-UdpClientMap ClientsForProcessList(const ProcessList& processes);
+// process provided, which wait up to ack_timeout for each acknowledgement. If
+// link_auth is provided, every datagram sent to a process is authenticated for
+// it.
+UdpClientMap ClientsForProcessList(
+    const ProcessList& processes, udp::LinkAuthPtr link_auth = nullptr,
+    std::chrono::microseconds ack_timeout = kAckTimeout);
+
+// Determines if the datagram the client was created for was sent by process
+// pid. With link authentication, the sender is known exactly. Otherwise, only
+// its host can be compared, which is not complete for processes on the same
+// host, because we can not know the sending port of a process, only its
+// receiving port.
+bool SentBy(const ProcessList& processes, udp::ClientPtr client,
+            unsigned int pid);
 
 // Represents different types of malicious behavior a traitorous general can
 // exhibit. Individual instances are stored as bit flags by combining individual
@@ -93,24 +205,78 @@ MaliciousBehavior StringToMaliciousBehavior(std::string str);
 // Returns the string representation of the provided MaliciousBehavior.
 std::string MaliciousBehaviorString(MaliciousBehavior m);
 
+// Determines if a general exhibiting the provided behavior should send a
+// certain message.
+bool ShouldSendMsg(MaliciousBehavior b);
+// Possibly delay the send of a message, based on the provided behavior. Blocks
+// synchonously if delaying.
+void MaybeDelaySend(MaliciousBehavior b);
+// Determines the value a commander exhibiting the provided behavior should send
+// for a certain message when it was told to send value. A wrong Order is the
+// opposite Order, while any other wrong value is the value with its last byte
+// altered.
+msg::Value ValueForMsg(MaliciousBehavior b, const msg::Value& value);
+
+// The latencies a General observed over the course of the agreement algorithm,
+// from which tail behavior can be told apart from the common case. Rounds are
+// timed from their start, so the first round, which has none, is not.
+struct RoundLatencies {
+  // From the start of a round until it ended, whether complete or timed out.
+  LatencyHistogram round_duration;
+  // From the start of a round until its first message or marker arrived.
+  LatencyHistogram first_message;
+  // From the start of a round until it was complete, for rounds that were.
+  LatencyHistogram round_complete;
+  // From the first attempt to send a datagram until its acknowledgement
+  // arrived, for datagrams acknowledged without a retransmission.
+  LatencyHistogram ack_rtt;
+  // From the start of the algorithm until a Lieutenant decided. The Commander
+  // decides right away.
+  LatencyHistogram decision;
+};
+
+// Allow streaming of the summaries of RoundLatencies on ostreams, one line per
+// latency.
+std::ostream& operator<<(std::ostream& o, const RoundLatencies& l);
+
 // A abstract representation of a general process in the Byzantine Agreement
-// Algorithm. Extended by the Commander and Lieutenant classes.
+// Algorithm. Extended by the Commander and Lieutenant classes. The process
+// takes part in rounds up to last_round. Messages are authenticated with auth
+// and datagrams with link_auth, unless they are null, and acknowledged
+// according to ack.
 class General {
  public:
   General(const ProcessList& processes, unsigned int id, unsigned int faulty,
-          MaliciousBehavior behavior)
+          MaliciousBehavior behavior, unsigned int last_round,
+          std::shared_ptr<const MessageAuth> auth, udp::LinkAuthPtr link_auth,
+          const AckPolicy& ack)
       : processes_(processes),
-        clients_(ClientsForProcessList(processes)),
+        clients_(ClientsForProcessList(processes, link_auth, ack.timeout)),
         id_(id),
         faulty_(faulty),
         behavior_(behavior),
-        round_(0) {}
+        last_round_(last_round),
+        auth_(auth),
+        ack_(ack),
+        peer_counters_(processes.size() + 1),
+        round_(0),
+        stop_sending_(false) {}
 
   virtual ~General() = default;
 
-  // Runs the Byzantine Agreement Algorithm and decides on an order by
+  // Runs the Byzantine Agreement Algorithm and decides on a value by
   // coordinating with peer processes.
-  virtual msg::Order Decide() = 0;
+  virtual msg::Value Decide() = 0;
+
+  // Returns the latencies observed so far. They keep being recorded while
+  // sending in the background after deciding.
+  inline const RoundLatencies& Latencies() const { return latencies_; }
+
+  // Writes what was exchanged with each peer so far as a single line of JSON:
+  // the counts of its udp::Client merged with its PeerCounters, and those of
+  // the server, if any. Datagrams that could not be attributed to a peer are
+  // counted under a null peer.
+  void WriteTransportStats(std::ostream& o) const;
 
  protected:
   const ProcessList processes_;
@@ -118,6 +284,72 @@ class General {
   const unsigned int id_;
   const unsigned int faulty_;
   const MaliciousBehavior behavior_;
+  const unsigned int last_round_;
+  const std::shared_ptr<const MessageAuth> auth_;
+  const AckPolicy ack_;
+
+  RoundLatencies latencies_;
+  // The counters of each process by ID, followed by those of datagrams that
+  // could not be attributed to any (see CountersFor).
+  mutable std::vector<PeerCounters> peer_counters_;
+
+  // Returns the counters of process pid, or of unattributed datagrams if
+  // absent.
+  inline PeerCounters& CountersFor(
+      std::experimental::optional<unsigned int> pid) const {
+    return pid ? peer_counters_.at(*pid) : peer_counters_.back();
+  }
+  // Returns the process the client is from: the peer it was authenticated as,
+  // or the one claimed by its datagram if the client can be from it (see
+  // SentBy). Absent if neither is known.
+  std::experimental::optional<unsigned int> Attribute(
+      udp::ClientPtr client,
+      std::experimental::optional<unsigned int> claimed) const;
+
+  // Returns the counts of the server, if the General has one.
+  virtual std::experimental::optional<udp::ServerCounts> ServerStats() const {
+    return {};
+  }
+
+  // Calls attempt with the index of the attempt, which sends the datagram with
+  // the provided id to process pid once and returns whether it was
+  // acknowledged, until it is, every attempt allowed by ack_ is spent, or
+  // StopSending is called. Returns whether the datagram was acknowledged.
+  //
+  // An acknowledgement heard during a retransmission may answer any earlier
+  // attempt, so like in Karn's algorithm, attempts after the first should not
+  // time it (see RoundSkew).
+  template <class Attempt>
+  bool AttemptUntilStopped(unsigned int pid, const AckId& id,
+                           Attempt attempt) const {
+    auto& stats = peer_counters_.at(pid);
+    auto first_sent = std::chrono::steady_clock::now();
+    for (unsigned int i = 0;
+         !stop_sending_ && (ack_.attempts == 0 || i < ack_.attempts); ++i) {
+      if (i > 0) stats.retransmits++;
+      tracing::trace.Record(i == 0 ? tracing::EventType::SEND
+                                   : tracing::EventType::RETRANSMIT,
+                            pid, id.round, id.seq, i);
+      if (attempt(i)) {
+        if (tracing::trace.Enabled()) {
+          auto rtt = std::chrono::duration_cast<std::chrono::microseconds>(
+              std::chrono::steady_clock::now() - first_sent);
+          tracing::trace.Record(tracing::EventType::ACK, pid, id.round, id.seq,
+                                rtt.count());
+        }
+        return true;
+      }
+    }
+    if (!stop_sending_) {
+      stats.give_ups++;
+      tracing::trace.Record(tracing::EventType::GIVE_UP, pid, id.round,
+                            id.seq);
+    }
+    return false;
+  }
+  // Makes every sender stop after its current attempt (see
+  // AttemptUntilStopped).
+  inline void StopSending() { stop_sending_ = true; }
 
   // Returns the UDP client for a given process ID.
   inline udp::ClientPtr ClientForId(unsigned int pid) const {
@@ -130,108 +362,282 @@ class General {
   }
   // Determines if the General should send a certain message, based on its
   // malicious behavior.
-  bool ShouldSendMsg();
+  inline bool ShouldSendMsg() const {
+    return generals::ShouldSendMsg(behavior_);
+  }
   // Possibly delay the send of a message, based on the General's malicious
   // behavior. Blocks synchonously if delaying.
-  void MaybeDelaySend();
+  inline void MaybeDelaySend() const { generals::MaybeDelaySend(behavior_); }
 
   unsigned int round_;
   // Determines if this is the first round of the algorithm.
   inline bool FirstRound() const { return round_ == 0; }
   // Determines if this is the last round of the algorithm.
-  inline bool LastRound() const { return round_ == faulty_ + 1; };
+  inline bool LastRound() const { return round_ == last_round_; };
   // Increments the round number.
   inline void IncrementRound() {
     round_++;
-    logging::out << "Moving to round " << round_ << "\n";
+    LOG(INFO) << "Moving to round " << round_ << "\n";
   };
+
+  // Logs the authentication work done since the last call, if messages are
+  // authenticated.
+  inline void LogAuthStats() const {
+    if (auth_) {
+      LOG(INFO) << "Round " << round_ << " authentication: "
+                << auth_->TakeStats() << "\n";
+    }
+  }
+ private:
+  // Whether senders should stop after their current attempt.
+  std::atomic<bool> stop_sending_;
+};
+
+// The outcome of delivering the orders of the Commander.
+struct Delivery {
+  // The number of Lieutenants that acknowledged their order.
+  size_t acknowledged;
+  // The number of Lieutenants an order was sent to.
+  size_t sent;
+  // Whether every order was acknowledged or had every attempt spent before the
+  // delivery deadline.
+  bool finished;
+  // The time from the decision until the delivery finished or was given up on.
+  std::chrono::microseconds took;
+};
+
+// A decision of the Commander made without waiting for its orders to be
+// delivered.
+struct AsyncDecision {
+  msg::Value value;
+  // Becomes ready once the delivery finished or its deadline passed.
+  std::future<Delivery> delivery;
 };
 
 // A representation of a commander process in the Byzantine Agreement Algorithm.
+// In every protocol, the Commander only takes part in the first round, which it
+// starts once the loyal Lieutenants are ready (see WaitForReady).
 class Commander : public General {
  public:
-  Commander(const ProcessList& processes, unsigned int faulty, msg::Order order,
-            MaliciousBehavior behavior)
-      : General(processes, 0, faulty, behavior), order_(order) {}
-
-  msg::Order Decide();
+  Commander(const ProcessList& processes, unsigned int faulty, msg::Value value,
+            MaliciousBehavior behavior,
+            std::shared_ptr<const MessageAuth> auth = nullptr,
+            udp::LinkAuthPtr link_auth = nullptr,
+            const AckPolicy& ack = kDefaultAckPolicy)
+      : General(processes, 0, faulty, behavior, 0, auth, link_auth, ack),
+        link_auth_(link_auth),
+        value_(value) {}
+
+  // Stops delivering orders after the current attempts, if still delivering.
+  ~Commander();
+
+  // Decides and waits for the orders to be delivered.
+  msg::Value Decide();
+
+  // Returns the value of the Commander right away, while its orders are
+  // delivered in the background, so that the latency of the Commander does not
+  // depend on the slowest Lieutenant. If a deadline is provided, Lieutenants
+  // that have not acknowledged their order by then, counting from this call,
+  // are given up on after their current attempt. Must only be called once.
+  AsyncDecision DecideAsync(
+      std::experimental::optional<std::chrono::microseconds> deadline = {});
 
  private:
-  const msg::Order order_;
+  const udp::LinkAuthPtr link_auth_;
+  const msg::Value value_;
+
+  // Delivers the orders in the background (see DecideAsync).
+  std::thread delivery_;
+
+  // Sends the orders once the Lieutenants are ready, fulfilling the promise
+  // once they are delivered or the deadline after start passes.
+  void Deliver(std::chrono::steady_clock::time_point start,
+               std::experimental::optional<std::chrono::microseconds> deadline,
+               std::promise<Delivery> promise);
 
-  // Determins the order a Commander should send for a certain message, based on
+  // Determins the value a Commander should send for a certain message, based on
   // the Commander's malicious behavior.
-  msg::Order OrderForMsg() const;
+  msg::Value ValueForMsg() const;
 };
 
 // A representation of a lieutenant process in the Byzantine Agreement
-// Algorithm.
+// Algorithm. It drives the rounds of the provided protocol over UDP. Rounds
+// time out after the provided deadline, which adapts to observed latency.
 class Lieutenant : public General {
  public:
   Lieutenant(const ProcessList& processes, unsigned int id,
              unsigned short server_port, unsigned int faulty,
-             MaliciousBehavior behavior)
-      : General(processes, id, faulty, behavior),
-        server_(server_port, kRoundTimeout) {}
-
-  msg::Order Decide();
+             MaliciousBehavior behavior, const ProtocolSpec& spec,
+             std::shared_ptr<const MessageAuth> auth = nullptr,
+             udp::LinkAuthPtr link_auth = nullptr,
+             const RoundDeadline& deadline =
+                 RoundDeadline(MinRoundTimeout(kDefaultAckPolicy),
+                               kRoundTimeout),
+             const AckPolicy& ack = kDefaultAckPolicy)
+      : General(processes, id, faulty, behavior, spec.LastRound(), auth,
+                link_auth, ack),
+        server_(server_port, link_auth),
+        spec_(spec),
+        protocol_(spec.New(id)),
+        deadline_(deadline),
+        skew_(ack.timeout),
+        late_this_round_(false),
+        transitioning_(false),
+        transition_ready_(false),
+        senders_running_(0) {}
+
+  // Stops relaying after the current attempts, if still relaying.
+  ~Lieutenant();
+
+  // Runs the rounds and returns the decision as soon as the last one ends,
+  // while the messages of the last round are still relayed in the background
+  // (see Drain).
+  msg::Value Decide();
+
+  // Waits for the messages of the last round to be relayed after Decide, for
+  // at most the provided deadline. Relays that are still unacknowledged by
+  // then are given up on after their current attempt.
+  void Drain(
+      std::experimental::optional<std::chrono::microseconds> deadline = {});
 
  private:
   const udp::Server server_;
-
-  // The set of unique orders seen orders over the course of the agreement
-  // algorithm.
-  std::set<msg::Order> orders_seen_;
-
-  // Decides what the order should be based on the seen orders over the course
-  // of the agreement algorithm. Defined as follows:
-  //
-  // choice(V) := v        if V = {v}
-  //            | RETREAT  if V = {} or |V| >= 2
-  //
-  inline msg::Order DecideOrder() const;
+  const ProtocolSpec spec_;
+
+  // The state of the agreement protocol, such as the values seen and the
+  // messages received this round.
+  std::unique_ptr<Protocol> protocol_;
+
+  // The deadline of each round, learned from the rounds before it.
+  RoundDeadline deadline_;
+  // Estimates when the other processes started the round, from the
+  // acknowledgements of the messages we send.
+  RoundSkew skew_;
+
+  // Messages and done markers from later rounds, keyed by round, buffered so
+  // that processes that are slightly ahead do not have to retransmit them.
+  // Messages are kept with their sequence numbers.
+  std::multimap<unsigned int, std::pair<uint32_t, msg::Message>> future_msgs_;
+  std::multimap<unsigned int, unsigned int> future_done_;
+  // The number of messages and markers buffered per sending process.
+  std::unordered_map<unsigned int, size_t> buffered_per_sender_;
+
+  std::experimental::optional<udp::ServerCounts> ServerStats() const {
+    return server_.Counts();
+  }
 
   // Per-round variables:
 
-  // Timestamp at the begining of the round, used as a backup round timeout
-  // because socket timeouts alone are not sufficient (see
-  // ContinueUnlessTimeout). steady_clock (monotonic) to measure elapsed time
+  // Timestamp at the begining of the round, from which the round deadline is
+  // armed on the server. steady_clock (monotonic) to measure elapsed time
   // accurately even in the face of clock resets.
   std::chrono::steady_clock::time_point round_start_ts_;
-  // Contains the set of all unique messages received so far this round.
-  std::set<msg::Message> msgs_this_round_;
-  // Same as msgs_this_round_, except with only the ids so that all messages
-  // with the same process list collide.
-  std::set<std::vector<unsigned int>> ids_this_round_;
+  // The time the round ends, which is the deadline after the start of the
+  // round, aligned with the other processes (see AlignDeadline).
+  std::chrono::steady_clock::time_point deadline_ts_;
+  // The time since the start of the round at which its last message arrived,
+  // if any did.
+  std::experimental::optional<std::chrono::microseconds> last_arrival_;
+  // Whether a message from an earlier round arrived during this round.
+  bool late_this_round_;
+  // The sender and sequence number of each message and marker handed to the
+  // protocol this round, to count duplicates (see AckId).
+  std::set<std::pair<unsigned int, uint32_t>> seen_this_round_;
+  // Whether the round was entered, but is still being prepared by
+  // transition_, so that its datagrams are buffered until it starts.
+  bool transitioning_;
+  // Prepares the round while the server keeps receiving (see BeginRound).
+  std::thread transition_;
+  // Whether transition_ is done preparing the round, guarded by
+  // transition_mu_.
+  std::mutex transition_mu_;
+  bool transition_ready_;
   // Holds the sender threads for the given round.
   threadutil::ThreadGroup sender_threads_this_round_;
+  // The number of sender threads that are still sending, signaled through
+  // senders_idle_ once it drops to zero.
+  std::mutex senders_mu_;
+  std::condition_variable senders_idle_;
+  size_t senders_running_;
+
+  // Returns the timing of an acknowledgement for the provided round of a
+  // datagram received at the provided time.
+  AckTiming TimingForAckOf(
+      unsigned int round, std::chrono::steady_clock::time_point received) const;
+  // Moves the end of the round to the deadline after the median start of the
+  // round among the processes sampled by skew_, rearming the server if it
+  // changed.
+  void AlignDeadline();
+
+  // Records the arrival of a valid message or marker from the provided round
+  // for the round deadline.
+  void NoteArrival(unsigned int round);
+  // Buffers a valid message or marker with the provided id from a later round
+  // and the provided process, acknowledging it right away, as long as the
+  // process has not exceeded its share of the buffer. Otherwise, does not
+  // acknowledge it so that it is sent again later. Returns whether it was
+  // buffered.
+  bool BufferForRound(udp::ClientPtr client, const AckId& id,
+                      unsigned int sender,
+                      std::chrono::steady_clock::time_point received);
+  // Hands the messages and markers buffered for the current round to the
+  // protocol.
+  void ReplayBuffered();
+  // Records that a message or marker with the provided sequence number from
+  // the provided process is handed to the protocol this round, counting it as
+  // a duplicate if it was before.
+  void NoteSeen(unsigned int sender, uint32_t seq);
+  // Counts a datagram from the client rejected for the provided reason, which
+  // claims to be from the provided process, if any (see Attribute).
+  void CountRejected(udp::ClientPtr client,
+                     std::experimental::optional<unsigned int> claimed,
+                     Rejection reason) const;
+  // Reports the timing of the round that is ending and feeds it to the round
+  // deadline.
+  void EndRound();
 
-  // Decides if the current round is complete based on the number of messages
-  // received.
-  inline bool RoundComplete() const;
-
-  // Checks if the round has timed out and returns an action accordingly. If the
-  // round has not yet timed out, the server will be told to continue. We need
-  // both a round timeout and a socket timeout so that faulty processes cannot
-  // continue to send messages to reset the socket timeout without ever actually
-  // making forward progress.
-  udp::ServerAction ContinueUnlessTimeout();
   // Handles a round timeout, moving to the next round if necessary.
   udp::ServerAction HandleRoundTimeout();
   // Handles moving to the next round, unless this is as already the last round.
   udp::ServerAction MoveToNewRoundOrStop();
 
+  // Determines if datagrams from the provided round have to wait for it to
+  // start: either it is a later round, or it is still being prepared.
+  inline bool Early(unsigned int round) const {
+    return round > round_ || (round == round_ && transitioning_);
+  }
+
   // Waits for all sender threads to drain and terminate before clearing the
   // sender_threads_this_round_ vector.
   void ClearSenders();
-  // Handles a new round by setting up per-round variables and launching threads
-  // (senders) to send round related messages.
-  void InitNewRound();
+  // Ends the current round and enters the next one, which transition_ prepares
+  // in the background (see PrepareRound), while the server keeps receiving and
+  // buffers its datagrams.
+  void BeginRound();
+  // Runs on transition_: waits for the senders of the previous round, and
+  // launches threads (senders) to send the messages of the round. Then wakes up
+  // the server through its round timer.
+  void PrepareRound();
+  // Starts the round once transition_ is done preparing it, setting up
+  // per-round variables and handing the protocol the datagrams buffered for
+  // it. Moves on right away if the round is complete without any more.
+  udp::ServerAction StartRoundIfPrepared();
+
+  // Handles a done marker of n bytes from the provided Lieutenant for the
+  // provided round, received at the provided time.
+  udp::ServerAction HandleDone(udp::ClientPtr client, unsigned int round,
+                               unsigned int sender, size_t n,
+                               std::chrono::steady_clock::time_point received);
 
   // Validates that the message makes sense in the current context of the
-  // algorithm and verifies that it is properly formatted. This protects against
-  // malicious messages.
-  bool ValidMessage(const msg::Message& msg, const net::Address& from) const;
+  // algorithm and verifies that it is properly formatted, sent by the client
+  // and, if messages are authenticated, authentic. This protects against
+  // malicious messages. Returns why the message is invalid, if it is.
+  std::experimental::optional<Rejection> CheckMessage(
+      const msg::Message& msg, udp::ClientPtr client) const;
+  // Validates that the sender is a Lieutenant other than ourselves and sent
+  // the datagram of the client (see SentBy).
+  bool ValidSender(unsigned int sender, udp::ClientPtr client) const;
 };
 
 }  // namespace generals
@@ -0,0 +1,93 @@
+#include "histogram.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace generals {
+
+std::ostream& operator<<(std::ostream& o, const LatencySummary& s) {
+  o << "{count: " << s.count;
+  if (s.count > 0) {
+    o << ", p50: " << s.p50.count() << "us, p90: " << s.p90.count()
+      << "us, p99: " << s.p99.count() << "us, max: " << s.max.count() << "us";
+  }
+  return o << "}";
+}
+
+LatencyHistogram::LatencyHistogram() : max_(0) {
+  for (auto& c : counts_) c = 0;
+}
+
+void LatencyHistogram::Record(std::chrono::microseconds d) {
+  uint64_t us = d.count() < 0 ? 0 : d.count();
+  counts_[Bucket(us)].fetch_add(1, std::memory_order_relaxed);
+  uint64_t max = max_.load(std::memory_order_relaxed);
+  while (us > max && !max_.compare_exchange_weak(max, us)) {
+  }
+}
+
+uint64_t LatencyHistogram::Count() const {
+  uint64_t count = 0;
+  for (auto const& c : counts_) count += c.load(std::memory_order_relaxed);
+  return count;
+}
+
+LatencySummary LatencyHistogram::Summarize() const {
+  // Take a snapshot, since durations may be recorded meanwhile.
+  std::array<uint64_t, kBuckets> counts;
+  uint64_t total = 0;
+  for (size_t b = 0; b < kBuckets; ++b) {
+    counts[b] = counts_[b].load(std::memory_order_relaxed);
+    total += counts[b];
+  }
+  uint64_t max = max_.load(std::memory_order_relaxed);
+
+  auto percentile = [&](double percent) {
+    auto rank = std::max<uint64_t>(1, std::ceil(total * percent / 100));
+    uint64_t seen = 0;
+    for (size_t b = 0; b < kBuckets; ++b) {
+      seen += counts[b];
+      if (seen >= rank) {
+        return std::chrono::microseconds{std::min(BucketMax(b), max)};
+      }
+    }
+    return std::chrono::microseconds{max};
+  };
+
+  LatencySummary s = {};
+  s.count = total;
+  if (total > 0) {
+    s.p50 = percentile(50);
+    s.p90 = percentile(90);
+    s.p99 = percentile(99);
+    s.max = std::chrono::microseconds{max};
+  }
+  return s;
+}
+
+size_t LatencyHistogram::Bucket(uint64_t us) {
+  if (us < 2 * kHalfSubBuckets) {
+    return us;
+  }
+  // Shift the duration right until it falls in [kHalfSubBuckets,
+  // 2 * kHalfSubBuckets), which picks the bucket within its doubling.
+  unsigned int shift = 0;
+  while ((us >> shift) >= 2 * kHalfSubBuckets) ++shift;
+  if (shift > kHistogramShifts) {
+    return kBuckets - 1;
+  }
+  return 2 * kHalfSubBuckets + (shift - 1) * kHalfSubBuckets +
+         ((us >> shift) - kHalfSubBuckets);
+}
+
+uint64_t LatencyHistogram::BucketMax(size_t bucket) {
+  if (bucket < 2 * kHalfSubBuckets) {
+    return bucket;
+  }
+  size_t shift = (bucket - 2 * kHalfSubBuckets) / kHalfSubBuckets + 1;
+  uint64_t top = (bucket - 2 * kHalfSubBuckets) % kHalfSubBuckets +
+                 kHalfSubBuckets;
+  return ((top + 1) << shift) - 1;
+}
+
+}  // namespace generals
@@ -0,0 +1,67 @@
+#ifndef HISTOGRAM_H_
+#define HISTOGRAM_H_
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+
+namespace generals {
+
+// The number of buckets per power of two of a LatencyHistogram beyond the
+// first, which bounds its relative error to 1 / kHalfSubBuckets.
+const unsigned int kHalfSubBuckets = 32;
+// The number of doublings past 2 * kHalfSubBuckets microseconds that a
+// LatencyHistogram tells apart. Longer durations are counted as the longest
+// one, which is over a day.
+const unsigned int kHistogramShifts = 32;
+
+// The percentiles of the durations recorded by a LatencyHistogram.
+struct LatencySummary {
+  uint64_t count;
+  std::chrono::microseconds p50;
+  std::chrono::microseconds p90;
+  std::chrono::microseconds p99;
+  std::chrono::microseconds max;
+};
+
+// Allow streaming of LatencySummary on ostreams.
+std::ostream& operator<<(std::ostream& o, const LatencySummary& s);
+
+// Counts durations in buckets whose width grows with their magnitude, like an
+// HDR histogram: durations below 2 * kHalfSubBuckets microseconds are counted
+// exactly, and every doubling after that is split into kHalfSubBuckets
+// buckets. Any duration is kept within about 3% in a few kilobytes, no matter
+// how many are recorded. Recording is lock-free, so that sender threads can
+// record while the listener does.
+class LatencyHistogram {
+ public:
+  LatencyHistogram();
+
+  // Counts the duration. Negative durations are counted as zero.
+  void Record(std::chrono::microseconds d);
+
+  // Returns the number of durations recorded.
+  uint64_t Count() const;
+
+  // Returns the percentiles of the durations recorded so far. Each percentile
+  // is the largest duration of its bucket, but never more than the maximum.
+  LatencySummary Summarize() const;
+
+ private:
+  static const size_t kBuckets =
+      2 * kHalfSubBuckets + kHistogramShifts * kHalfSubBuckets;
+
+  std::array<std::atomic<uint64_t>, kBuckets> counts_;
+  std::atomic<uint64_t> max_;
+
+  // Returns the bucket the duration in microseconds is counted in.
+  static size_t Bucket(uint64_t us);
+  // Returns the largest duration in microseconds counted in the bucket.
+  static uint64_t BucketMax(size_t bucket);
+};
+
+}  // namespace generals
+
+#endif
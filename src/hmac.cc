@@ -0,0 +1,74 @@
+#include "hmac.h"
+
+#include <random>
+
+namespace crypto {
+
+namespace {
+
+// Returns the value of a hexadecimal digit, or -1 if it is not one.
+inline int HexDigit(char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+}  // namespace
+
+Hmac::Hmac(const Key& key) {
+  // Keys are never longer than a block, so they are only padded with zeros.
+  uint8_t ipad[64] = {};
+  uint8_t opad[64] = {};
+  for (size_t i = 0; i < sizeof(ipad); ++i) {
+    uint8_t k = i < key.size() ? key[i] : 0;
+    ipad[i] = k ^ 0x36;
+    opad[i] = k ^ 0x5c;
+  }
+  inner_.Update(ipad, sizeof(ipad));
+  outer_.Update(opad, sizeof(opad));
+}
+
+Digest Hmac::Mac(const void* data, size_t n) const {
+  Sha256 inner = inner_;
+  inner.Update(data, n);
+  Digest d = inner.Finish();
+
+  Sha256 outer = outer_;
+  outer.Update(d.data(), d.size());
+  return outer.Finish();
+}
+
+Key RandomKey() {
+  std::random_device random;
+  Key key;
+  for (size_t i = 0; i < key.size(); i += sizeof(uint32_t)) {
+    uint32_t r = random();
+    for (size_t j = 0; j < sizeof(uint32_t); ++j) {
+      key[i + j] = static_cast<uint8_t>(r >> (8 * j));
+    }
+  }
+  return key;
+}
+
+std::string KeyString(const Key& key) {
+  return DigestString(key);
+}
+
+std::experimental::optional<Key> KeyFromString(const std::string& str) {
+  Key key;
+  if (str.size() != 2 * key.size()) {
+    return {};
+  }
+  for (size_t i = 0; i < key.size(); ++i) {
+    int hi = HexDigit(str[2 * i]);
+    int lo = HexDigit(str[2 * i + 1]);
+    if (hi < 0 || lo < 0) {
+      return {};
+    }
+    key[i] = static_cast<uint8_t>(hi << 4 | lo);
+  }
+  return key;
+}
+
+}  // namespace crypto
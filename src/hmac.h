@@ -0,0 +1,42 @@
+#ifndef HMAC_H_
+#define HMAC_H_
+
+#include <array>
+#include <cstdint>
+#include <experimental/optional>
+#include <string>
+
+#include "sha256.h"
+
+namespace crypto {
+
+// Key is a secret key for HMAC-SHA256.
+typedef std::array<uint8_t, 32> Key;
+
+// Computes HMAC-SHA256 (RFC 2104) with a fixed key. The hash states after
+// absorbing the padded key are computed once up front, so that each MAC only
+// costs compressing the data plus two blocks.
+class Hmac {
+ public:
+  explicit Hmac(const Key& key);
+
+  // Returns the MAC of n bytes of data.
+  Digest Mac(const void* data, size_t n) const;
+
+ private:
+  Sha256 inner_;
+  Sha256 outer_;
+};
+
+// Returns a new random key.
+Key RandomKey();
+
+// Returns the hexadecimal representation of the key.
+std::string KeyString(const Key& key);
+// Parses a key from its hexadecimal representation. If the string is not a
+// valid key, the return value will be absent.
+std::experimental::optional<Key> KeyFromString(const std::string& str);
+
+}  // namespace crypto
+
+#endif
@@ -0,0 +1,83 @@
+#include "link_auth.h"
+
+#include <arpa/inet.h>
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+
+namespace udp {
+
+namespace {
+
+// Derives the key of the link from process `from` to process `to` from the key
+// they share, so that a datagram can not be reflected back to its sender.
+crypto::SipKey LinkKey(const crypto::Key& shared, uint32_t from, uint32_t to) {
+  std::string label = "link";
+  from = htonl(from);
+  to = htonl(to);
+  label.append(reinterpret_cast<const char*>(&from), sizeof(from));
+  label.append(reinterpret_cast<const char*>(&to), sizeof(to));
+
+  auto mac = crypto::Hmac(shared).Mac(label.data(), label.size());
+  crypto::SipKey key;
+  std::copy(mac.begin(), mac.begin() + key.size(), key.begin());
+  return key;
+}
+
+}  // namespace
+
+LinkAuth::LinkAuth(unsigned int id, const std::vector<crypto::Key>& keys)
+    : id_(id) {
+  send_keys_.reserve(keys.size());
+  recv_keys_.reserve(keys.size());
+  for (unsigned int pid = 0; pid < keys.size(); ++pid) {
+    send_keys_.push_back(LinkKey(keys[pid], id, pid));
+    recv_keys_.push_back(LinkKey(keys[pid], pid, id));
+  }
+}
+
+LinkTrailer LinkAuth::Trailer(const char* buf, size_t n,
+                              unsigned int peer) const {
+  uint32_t sender = htonl(id_);
+  uint64_t tag = crypto::SipHash24(send_keys_.at(peer), buf, n);
+
+  LinkTrailer trailer;
+  std::memcpy(trailer.data(), &sender, sizeof(sender));
+  for (size_t i = 0; i < sizeof(tag); ++i) {
+    trailer[sizeof(sender) + i] = static_cast<char>(tag >> (8 * i));
+  }
+  return trailer;
+}
+
+std::experimental::optional<unsigned int> LinkAuth::Open(const char* buf,
+                                                         size_t& n) const {
+  if (n < kLinkTrailerSize) {
+    return {};
+  }
+  size_t size = n - kLinkTrailerSize;
+  const char* trailer = buf + size;
+
+  uint32_t sender;
+  std::memcpy(&sender, trailer, sizeof(sender));
+  sender = ntohl(sender);
+  if (sender >= recv_keys_.size() || sender == id_) {
+    return {};
+  }
+
+  // Compare the whole tag at once, so that the time taken does not reveal how
+  // much of a forged tag is correct.
+  uint64_t tag = 0;
+  for (size_t i = 0; i < sizeof(tag); ++i) {
+    uint8_t b = static_cast<uint8_t>(trailer[sizeof(sender) + i]);
+    tag |= static_cast<uint64_t>(b) << (8 * i);
+  }
+  if ((tag ^ crypto::SipHash24(recv_keys_[sender], buf, size)) != 0) {
+    return {};
+  }
+
+  n = size;
+  return sender;
+}
+
+}  // namespace udp
@@ -0,0 +1,57 @@
+#ifndef LINK_AUTH_H_
+#define LINK_AUTH_H_
+
+#include <array>
+#include <cstddef>
+#include <experimental/optional>
+#include <vector>
+
+#include "hmac.h"
+#include "siphash.h"
+
+namespace udp {
+
+// The size of the trailer that authenticates a datagram: the ID of the sender
+// followed by a SipHash tag.
+const size_t kLinkTrailerSize = sizeof(uint32_t) + sizeof(uint64_t);
+
+typedef std::array<char, kLinkTrailerSize> LinkTrailer;
+
+// Authenticates every datagram sent over the links between a fixed set of
+// processes. Each process appends a trailer to its datagrams holding its ID and
+// a MAC of the datagram, keyed with a key that is unique to the direction of
+// the link. Receivers check the trailer before decoding anything, so that the
+// sender of a datagram is known exactly, even among processes sharing a host,
+// and forged datagrams are dropped cheaply.
+//
+// The link keys are derived from the keys each pair of processes shares (see
+// ReadKeyFile), so no further keys need to be distributed.
+class LinkAuth {
+ public:
+  // Creates the link keys of process id given the keys it shares with every
+  // process, indexed by process ID.
+  LinkAuth(unsigned int id, const std::vector<crypto::Key>& keys);
+
+  // Returns the ID of this process.
+  inline unsigned int Id() const { return id_; };
+
+  // Returns the trailer to append to the n byte datagram sent to peer.
+  LinkTrailer Trailer(const char* buf, size_t n, unsigned int peer) const;
+
+  // Verifies the trailer at the end of the n byte datagram. If it is authentic,
+  // returns its sender and shrinks n to exclude the trailer. Otherwise, leaves
+  // n unchanged and returns nothing.
+  std::experimental::optional<unsigned int> Open(const char* buf,
+                                                 size_t& n) const;
+
+ private:
+  const unsigned int id_;
+  // The keys of the links from this process to each other one.
+  std::vector<crypto::SipKey> send_keys_;
+  // The keys of the links from each other process to this one.
+  std::vector<crypto::SipKey> recv_keys_;
+};
+
+}  // namespace udp
+
+#endif
@@ -1,8 +1,148 @@
 #include "log.h"
 
+#include <cstring>
+#include <stdexcept>
+
 namespace logging {
 
 // Needed to be defined in .cc file to avoid duplicate symbols.
 Logger out(&std::cerr);
 
+Ring::Ring() : slots_(new Slot[kRingSize]), push_pos_(0), pop_pos_(0) {
+  for (size_t i = 0; i < kRingSize; ++i) {
+    slots_[i].seq = i;
+  }
+}
+
+bool Ring::TryPush(Record& record) {
+  // Claim the next position, unless the slot there still holds a record from
+  // the previous lap, in which case the ring is full.
+  size_t pos = push_pos_.load(std::memory_order_relaxed);
+  Slot* slot;
+  while (true) {
+    slot = &slots_[pos & (kRingSize - 1)];
+    size_t seq = slot->seq.load(std::memory_order_acquire);
+    auto diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+    if (diff == 0) {
+      if (push_pos_.compare_exchange_weak(pos, pos + 1,
+                                          std::memory_order_relaxed)) {
+        break;
+      }
+    } else if (diff < 0) {
+      return false;
+    } else {
+      pos = push_pos_.load(std::memory_order_relaxed);
+    }
+  }
+  slot->record = std::move(record);
+  slot->seq.store(pos + 1, std::memory_order_release);
+  return true;
+}
+
+bool Ring::TryPop(Record& record) {
+  Slot& slot = slots_[pop_pos_ & (kRingSize - 1)];
+  size_t seq = slot.seq.load(std::memory_order_acquire);
+  if (seq != pop_pos_ + 1) {
+    return false;
+  }
+  record = std::move(slot.record);
+  slot.seq.store(pop_pos_ + kRingSize, std::memory_order_release);
+  pop_pos_++;
+  return true;
+}
+
+Level StringToLevel(const std::string& str) {
+  if (str == "off") return Level::OFF;
+  if (str == "info") return Level::INFO;
+  if (str == "debug") return Level::DEBUG;
+  throw std::invalid_argument(
+      "log level can be one of {\"off\", \"info\", \"debug\"}");
+}
+
+Logger::Logger(std::ostream* output)
+    : output_(output),
+      level_(Level::OFF),
+      dropped_(0),
+      threads_(0),
+      stop_(false) {}
+
+Logger::~Logger() {
+  if (writer_.joinable()) {
+    stop_ = true;
+    writer_.join();
+  }
+}
+
+void Logger::SetLevel(Level level) {
+  if (level != Level::OFF) {
+    std::lock_guard<std::mutex> lock(start_mu_);
+    if (!writer_.joinable()) {
+      start_ts_ = std::chrono::steady_clock::now();
+      writer_ = std::thread([this] { Write(); });
+    }
+  }
+  level_ = level;
+}
+
+std::ostringstream& Logger::Line() const {
+  thread_local std::ostringstream line;
+  return line;
+}
+
+void Logger::Commit(std::ostringstream& line) const {
+  thread_local unsigned int thread = threads_++;
+  Record record{std::chrono::steady_clock::now(), thread, line.str()};
+  line.str("");
+  if (!ring_.TryPush(record)) {
+    dropped_++;
+  }
+}
+
+void Logger::Write() {
+  uint64_t reported_drops = 0;
+  while (!stop_) {
+    if (!WriteAvailable(reported_drops)) {
+      std::this_thread::sleep_for(kWriterPollInterval);
+    }
+  }
+  WriteAvailable(reported_drops);
+}
+
+bool Logger::WriteAvailable(uint64_t& reported_drops) {
+  // Lines are written whole, so that they do not interleave with writes to
+  // the output that bypass the logger.
+  Record record;
+  std::ostringstream line;
+  bool any = false;
+  while (ring_.TryPop(record)) {
+    auto since = std::chrono::duration_cast<std::chrono::microseconds>(
+        record.ts - start_ts_);
+    line.str("");
+    line << "[t" << record.thread << " +" << since.count() << "us] "
+         << record.text;
+    *output_ << line.str();
+    any = true;
+  }
+  uint64_t dropped = dropped_;
+  if (dropped != reported_drops) {
+    *output_ << "[dropped " << dropped - reported_drops
+             << " lines while the log was full]\n";
+    reported_drops = dropped;
+    any = true;
+  }
+  if (any) output_->flush();
+  return any;
+}
+
+bool Logger::EndsLine(const char* s) {
+  size_t n = std::strlen(s);
+  return n > 0 && s[n - 1] == '\n';
+}
+
+bool Logger::EndsLine(const std::string& s) {
+  return !s.empty() && s.back() == '\n';
+}
+
+bool Logger::EndsLine(char c) { return c == '\n'; }
+
 }  // namespace logging
@@ -2,35 +2,171 @@
 #define LOG_H_
 
 #include <atomic>
+#include <chrono>
+#include <cstdint>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
 
 namespace logging {
 
-// A logger that can be turned on or off. A better alternative would be to use
-// macros, but this isn't a performance critical application.
+// How much is logged, from least to most.
+enum class Level : int {
+  OFF = 0,
+  // Events that happen a few times per round, like moving to the next round,
+  // timeouts and deadlines.
+  INFO = 1,
+  // Every message and marker sent, received and buffered.
+  DEBUG = 2,
+};
+
+// Maps a string to a Level, throwing an exception if the string is invalid.
+Level StringToLevel(const std::string& str);
+
+// The most verbose level compiled in, given at build time with
+// GENERALS_LOG_LEVEL (see the Makefile). Logging statements above it are dead
+// code, which the compiler removes.
+#ifndef GENERALS_LOG_LEVEL
+#define GENERALS_LOG_LEVEL 2
+#endif
+const Level kMaxLevel = static_cast<Level>(GENERALS_LOG_LEVEL);
+
+// The number of lines the Logger holds before it drops new ones. A power of
+// two.
+const size_t kRingSize = 4096;
+// How long the writer of a Logger sleeps when there is nothing to write.
+const auto kWriterPollInterval = std::chrono::milliseconds{1};
+
+// A line logged by a thread, waiting to be written.
+struct Record {
+  // When the line was completed.
+  std::chrono::steady_clock::time_point ts;
+  // The index of the thread that logged it, in the order threads first logged.
+  unsigned int thread;
+  // The line, including its newline.
+  std::string text;
+};
+
+// A bounded lock-free queue of records, written by any number of threads and
+// read by a single one (after Vyukov). Each slot carries a sequence number that
+// tells whether it is free for the producer claiming that position, or holds a
+// record for the consumer.
+class Ring {
+ public:
+  Ring();
+
+  // Moves the record into the ring, unless it is full. Returns whether it was
+  // pushed. Safe to call from any thread.
+  bool TryPush(Record& record);
+
+  // Moves the oldest record out of the ring, if any. Returns whether there was
+  // one. Must only be called from a single thread.
+  bool TryPop(Record& record);
+
+ private:
+  struct Slot {
+    std::atomic<size_t> seq;
+    Record record;
+  };
+
+  std::unique_ptr<Slot[]> slots_;
+  std::atomic<size_t> push_pos_;
+  size_t pop_pos_;
+};
+
+// A logger that logs up to a level, which is off until set. Each thread builds
+// its lines on its own, and hands every complete line to a background writer
+// through a lock-free ring, so that lines from concurrent threads never
+// interleave and no thread ever waits on the output. Each line is written with
+// the index of its thread and the time since logging was turned on. When the
+// writer falls behind and the ring is full, lines are dropped, and the writer
+// reports how many were.
 class Logger {
  public:
-  Logger(std::ostream* output) : output_(output), enabled_(false){};
+  Logger(std::ostream* output);
 
-  inline void enable(bool enable) { enabled_ = enable; };
+  // Writes every line still in the ring before returning.
+  ~Logger();
 
+  // Sets the most verbose level logged. The writer is started the first time
+  // logging is turned on.
+  void SetLevel(Level level);
+
+  // Determines if statements at the provided level are logged. The LOG macro
+  // checks this once per statement, so that the values of statements that are
+  // not logged are never even evaluated.
+  inline bool Enabled(Level level) const {
+    return level <= level_.load(std::memory_order_relaxed);
+  }
+
+  // Appends the value to the line of the calling thread. Only use through the
+  // LOG macro, which checks the level first.
   template <typename T>
   const Logger& operator<<(const T& v) const {
-    if (enabled_) {
-      *output_ << v;
-    }
+    auto& line = Line();
+    line << v;
+    if (EndsLine(v)) Commit(line);
     return *this;
   }
 
+  // Returns the number of lines dropped so far because the ring was full.
+  inline uint64_t Dropped() const { return dropped_; }
+
  private:
   std::ostream* output_;
-  std::atomic<bool> enabled_;
+  std::atomic<Level> level_;
+
+  mutable Ring ring_;
+  mutable std::atomic<uint64_t> dropped_;
+  mutable std::atomic<unsigned int> threads_;
+
+  // The background writer, started once under start_mu_, which runs until
+  // stop_ is set.
+  std::mutex start_mu_;
+  std::thread writer_;
+  std::atomic<bool> stop_;
+  std::chrono::steady_clock::time_point start_ts_;
+
+  // Returns the line the calling thread is building.
+  std::ostringstream& Line() const;
+  // Hands the line of the calling thread to the writer, and starts a new one.
+  void Commit(std::ostringstream& line) const;
+  // Writes the records in the ring until stopped, and then what is left.
+  void Write();
+  // Writes the records in the ring, and the number dropped since the last
+  // call. Returns whether there were any.
+  bool WriteAvailable(uint64_t& reported_drops);
+
+  // Determine if a value completes a line, which only strings and characters
+  // ending with a newline do.
+  template <typename T>
+  static bool EndsLine(const T&) {
+    return false;
+  }
+  static bool EndsLine(const char* s);
+  static bool EndsLine(const std::string& s);
+  static bool EndsLine(char c);
 };
 
 // The global logger. This should always be used instead of creating new Logger
-// instances.
+// instances, through the LOG macro.
 extern Logger out;
 
 }  // namespace logging
 
+// Logs a statement at the provided level, like:
+//   LOG(DEBUG) << "Sending  " << msg << " to p" << pid << "\n";
+// The rest of the statement is only evaluated if the level is logged, and is
+// compiled out if the level is above kMaxLevel. A line may be built over
+// several statements at the same level, and is logged once it ends with a
+// newline.
+#define LOG(level)                                      \
+  if (logging::Level::level > logging::kMaxLevel ||     \
+      !logging::out.Enabled(logging::Level::level)) {   \
+  } else                                                \
+    logging::out
+
 #endif
@@ -1,16 +1,23 @@
+#include <algorithm>
 #include <exception>
 #include <experimental/optional>
 #include <fstream>
 #include <iostream>
 #include <memory>
 #include <set>
+#include <sstream>
 #include <string>
 #include <vector>
 
 #include "args.h"
+#include "calibration.h"
+#include "capacity.h"
+#include "engine.h"
 #include "general.h"
 #include "log.h"
 #include "net.h"
+#include "trace.h"
+#include "trace_analysis.h"
 
 const std::string program_desc =
     "An implementation of the Byzantine Agreement Algorithm.";
@@ -51,18 +58,141 @@ const std::string order_desc =
     "The order can be either \"attack\" or \"retreat\". If specified, the "
     "process will be the Commander and will send the specified order. "
     "Otherwise, the process will be a lieutenant.";
+const std::string value_desc =
+    "An opaque value to propose instead of an order. If specified, the "
+    "process will be the Commander and will send the specified value. The "
+    "values \"attack\" and \"retreat\" are the same as the orders. "
+    "Lieutenants that can not agree on a value decide to retreat.";
+const std::string value_file_desc =
+    "Like --value, but proposes the contents of the file at the provided path, "
+    "such as a batch of client commands or its hash.";
 const std::string malicious_desc =
     "A list of malicious behaviors that the process can exhibit. Multiple "
     "behaviors can be provided by repeating the flag. Options:\n"
     "-\"silent\": send no messages (lieutenants only)\n"
     "-\"delay_send\": delays the send of messages\n"
     "-\"partial_send\": occasionally drop messages (lieutenants only)\n"
-    "-\"wrong_order\": occasionally send the wrong order (commander only)\n";
+    "-\"wrong_order\": occasionally send the wrong order or value (commander "
+    "only)\n";
 const std::string id_desc =
     "The optional id specifier of this process. Only needed if multiple "
     "processes in the hostfile are running on the same host, otherwise it can "
     "be deduced from the hostfile. 0-indexed.";
-const std::string verbose_desc = "Sets the logging level to verbose.";
+const std::string instances_desc =
+    "The number of independent agreement instances to run concurrently. All "
+    "instances share the rounds and sockets of the process, and messages for "
+    "the same process in the same round are batched into shared datagrams. "
+    "The commander proposes its value in every instance. Must be the same for "
+    "all processes. Defaults to 1.";
+const std::string waves_desc =
+    "The number of waves of --instances instances to run back-to-back. "
+    "Without --pipeline, each wave starts once the previous one has finished. "
+    "Must be the same for all processes. Defaults to 1.";
+const std::string pipeline_desc =
+    "Pipelines consecutive waves so that the first round of each wave starts "
+    "one round after the first round of the previous one, with the rounds of "
+    "overlapping waves sharing datagrams. Must be the same for all processes.";
+const std::string relay_once_desc =
+    "Relays each value only the first time it is seen, and nothing once two "
+    "values have been seen, instead of relaying every message. Rounds then "
+    "complete once every lieutenant has marked itself done with the round. "
+    "Needs O(n^2 * faulty) messages instead of O(n^(faulty + 1)). Must be the "
+    "same for all processes.";
+const std::string protocol_desc =
+    "The agreement protocol to run. Options:\n"
+    "-\"signed\": the algorithm with signed messages, which tolerates any "
+    "number of faulty processes in (faulty + 2) rounds (default)\n"
+    "-\"phase_king\": the Phase King algorithm, which needs far fewer "
+    "messages, but more than (4 * faulty + 1) processes and "
+    "(2 * faulty + 3) rounds\n"
+    "Must be the same for all processes.";
+const std::string keys_desc =
+    "Authenticates every datagram, and signs every hop of every message, with "
+    "the keys in the provided file, as written by --generate_keys. Must be "
+    "given to all processes or none.";
+const std::string generate_keys_desc =
+    "Generates fresh keys for every pair of processes and a signing key pair "
+    "for every process in the hostfile, writes the keys of each process to "
+    "\"keys.<line>\" in the provided directory and exits. Each process should "
+    "only be given its own file.";
+const std::string min_round_timeout_desc =
+    "The shortest time in milliseconds a lieutenant waits for the messages of "
+    "a round. Round deadlines adapt to the latency observed in recent rounds "
+    "within these bounds, which are never below the ack timeout times the "
+    "number of send attempts, so that retransmitted messages are not dropped "
+    "as late. Defaults to that floor, 750 without --calibrate.";
+const std::string max_round_timeout_desc =
+    "The longest time in milliseconds a lieutenant waits for the messages of "
+    "a round, which is also the deadline before any latency has been "
+    "observed. Set both bounds to the same value for fixed deadlines. "
+    "Defaults to 1000.";
+const std::string calibrate_desc =
+    "Measures the round trip time and loss rate to every process at startup, "
+    "and derives the ack timeout, the number of send attempts and the longest "
+    "round timeout from them instead of using the defaults. The measurements "
+    "and the chosen timeouts are logged with --verbose. Must be given to all "
+    "processes or none, which should be started together.";
+const std::string calibration_pings_desc =
+    "The number of pings sent to every process when calibrating. Defaults to "
+    "20.";
+const std::string target_success_desc =
+    "The probability that a datagram is acknowledged before its sender gives "
+    "up on it, which calibrated timeouts aim for. Defaults to 0.999999.";
+const std::string delivery_deadline_desc =
+    "The longest time in milliseconds the commander keeps sending its order "
+    "after printing its decision, which it does right away. Lieutenants that "
+    "have not acknowledged the order by then are given up on. Defaults to no "
+    "deadline, in which case every attempt is spent.";
+const std::string drain_deadline_desc =
+    "The longest time in milliseconds a lieutenant keeps relaying the "
+    "messages of the last round after printing its decision, which it does as "
+    "soon as the last round ends. Relays that are not acknowledged by then are "
+    "given up on. Defaults to no deadline, in which case every attempt is "
+    "spent.";
+const std::string plan_desc =
+    "Prints what the commander and each lieutenant would send, receive and "
+    "hold in every round of a system of the provided number of processes "
+    "tolerating --faulty ones, and how long each round would take, and exits. "
+    "Fails if a round can not finish within --max_round_timeout. Only signed "
+    "messages relaying every message can be planned. The size of the value is "
+    "taken from --value or --value_file, if given.";
+const std::string plan_rtt_desc =
+    "The round trip time in microseconds between any two processes assumed by "
+    "--plan. Defaults to 200.";
+const std::string latencies_desc =
+    "Prints the 50th, 90th and 99th percentiles and the maximum of the round "
+    "durations, the times to the first message and to completing each round, "
+    "the acknowledgement round trips and the time to decision observed by "
+    "this process to stderr before exiting. Only applies to a single "
+    "instance, and is rejected with more than one.";
+const std::string transport_stats_desc =
+    "Writes what this process exchanged with each other process to the file "
+    "at the provided path before exiting, as a single line of JSON: datagrams "
+    "and bytes in each direction, retransmits, acknowledgement timeouts, "
+    "datagrams given up on, duplicates, late arrivals and invalid datagrams "
+    "by reason. Only applies to a single instance, and is rejected with more "
+    "than one.";
+const std::string trace_desc =
+    "Records every datagram sent, retransmitted, acknowledged, given up on, "
+    "received and rejected, and the start and end of every round, into a "
+    "binary ring in the file at the provided path, mapped in memory so that "
+    "it survives a crash. Processes are numbered with the commander as p0. "
+    "Read the file with --analyze_trace. Only applies to a single instance.";
+const std::string trace_events_desc =
+    "The number of events the --trace file holds, rounded up to a power of "
+    "two, before the oldest are overwritten. Defaults to 65536.";
+const std::string analyze_trace_desc =
+    "Prints the timeline of every round and the datagrams exchanged with each "
+    "peer, with the percentiles of their acknowledgement round trips, from "
+    "the --trace file at the provided path, and exits.";
+const std::string verbose_desc =
+    "Sets the logging level to verbose, which is the same as --log_level "
+    "debug.";
+const std::string log_level_desc =
+    "Sets how much is logged to stderr: \"off\" (the default), \"info\" for "
+    "events that happen a few times per round, like timeouts and round "
+    "deadlines, or \"debug\" for every message as well. Levels compiled out "
+    "at build time are never logged.";
 const std::string red_start = "\033[1;31m";
 const std::string red_end = "\033[0m";
 
@@ -140,33 +270,98 @@ void ValidateCommanderId(generals::ProcessList& processes, int commander_id) {
 }
 
 // Validate the fault flag.
-void ValidateFaultyCount(const generals::ProcessList& processes, int faulty) {
+void ValidateFaultyCount(int faulty) {
   if (faulty < 0) {
     throw args::ValidationError("faulty count must be non-negative");
   }
-  if ((size_t)faulty + 2 > processes.size()) {
+}
+
+// Determine which protocol to run, and validate that it can tolerate the faulty
+// processes.
+generals::ProtocolSpec GetProtocol(size_t process_num, StringFlag& protocol,
+                                   int faulty, bool relay_once) {
+  try {
+    auto type = generals::ProtocolType::SIGNED_MESSAGES;
+    if (protocol) {
+      type = generals::StringToProtocolType(args::get(protocol));
+    }
+    auto relay_mode =
+        relay_once ? generals::RelayMode::ONCE : generals::RelayMode::ALL;
+    return generals::ProtocolSpec(type, process_num, faulty, relay_mode);
+  } catch (const std::invalid_argument& e) {
+    throw args::ValidationError(e.what());
+  }
+}
+
+// Reads the keys of this process. The keys of each process are ordered like
+// the hostfile, so they are reordered like the process list (see
+// ValidateCommanderId).
+generals::KeySet GetKeys(const generals::ProcessList& processes,
+                         const std::string& key_file, int commander_id) {
+  generals::KeySet keys;
+  try {
+    keys = generals::ReadKeyFile(key_file);
+  } catch (const std::runtime_error& e) {
+    throw args::ValidationError(e.what());
+  }
+  if (keys.shared.size() != processes.size()) {
     throw args::ValidationError(
-        "the total number of processes must be no less than (faulty + 2)");
+        "the key file must hold the keys of every process in the hostfile");
+  }
+  std::iter_swap(keys.shared.begin(), keys.shared.begin() + commander_id);
+  std::iter_swap(keys.verifying.begin(),
+                 keys.verifying.begin() + commander_id);
+  return keys;
+}
+
+// Reads the contents of the value file.
+msg::Value ReadValueFile(const std::string& path) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file) {
+    throw args::ValidationError("could not open value file");
   }
+  std::ostringstream contents;
+  contents << file.rdbuf();
+  return contents.str();
 }
 
-// Validate the order flag. Returns a present Order if this process is the
-// commander, or an absent Order if it is not.
-std::experimental::optional<msg::Order> ValidateOrder(StringFlag& order,
+// Validate the order, value and value_file flags. Returns a present Value if
+// this process is the commander, or an absent Value if it is not.
+std::experimental::optional<msg::Value> ValidateValue(StringFlag& order,
+                                                      StringFlag& value,
+                                                      StringFlag& value_file,
                                                       bool is_commander) {
+  int given = (order ? 1 : 0) + (value ? 1 : 0) + (value_file ? 1 : 0);
   if (is_commander) {
-    if (!order) {
+    if (given == 0) {
       throw args::UsageError("the commander must specify an order");
     }
+    if (given > 1) {
+      throw args::UsageError(
+          "only one of --order, --value and --value_file can be specified");
+    }
 
-    try {
-      auto order_val = args::get(order);
-      return msg::StringToOrder(order_val);
-    } catch (std::invalid_argument e) {
-      throw args::ValidationError(e.what());
+    msg::Value value_val;
+    if (order) {
+      try {
+        auto order_val = args::get(order);
+        return msg::OrderValue(msg::StringToOrder(order_val));
+      } catch (std::invalid_argument e) {
+        throw args::ValidationError(e.what());
+      }
+    } else if (value) {
+      value_val = args::get(value);
+    } else {
+      value_val = ReadValueFile(args::get(value_file));
+    }
+    if (value_val.size() > generals::kMaxValueSize) {
+      throw args::ValidationError("value can be at most " +
+                                  std::to_string(generals::kMaxValueSize) +
+                                  " bytes");
     }
+    return value_val;
   } else {
-    if (order) {
+    if (given > 0) {
       throw args::ValidationError(
           "only the commander process can specify an order");
     }
@@ -217,9 +412,214 @@ generals::MaliciousBehavior GetMaliciousBehavior(StringFlagList& malicious,
   return b;
 }
 
-// Prints the order that our process decided upon to stdout.
-void PrintOrder(int id, msg::Order decision) {
-  std::cout << id << ": Agreed on " << msg::OrderString(decision) << std::endl;
+// Validate the instances flag.
+void ValidateInstances(int instances) {
+  if (instances < 1) {
+    throw args::ValidationError("instances must be positive");
+  }
+}
+
+// Validate the waves flag.
+void ValidateWaves(int waves) {
+  if (waves < 1) {
+    throw args::ValidationError("waves must be positive");
+  }
+}
+
+// Determines how to calibrate from the calibration flags.
+generals::CalibrationOptions GetCalibrationOptions(
+    const generals::ProtocolSpec& spec, int faulty, IntFlag& pings,
+    args::ValueFlag<double>& target_success) {
+  generals::CalibrationOptions options;
+  options.pings = generals::kDefaultCalibrationPings;
+  if (pings) {
+    if (args::get(pings) < 1) {
+      throw args::ValidationError("calibration pings must be positive");
+    }
+    options.pings = args::get(pings);
+  }
+  options.target_success = generals::kDefaultTargetSuccess;
+  if (target_success) {
+    options.target_success = args::get(target_success);
+    if (!(options.target_success > 0 && options.target_success < 1)) {
+      throw args::ValidationError("target success must be in (0, 1)");
+    }
+  }
+  options.faulty = faulty;
+
+  // Only signed messages relaying every message know how many messages each
+  // process gets in a round.
+  options.messages_per_round = 1;
+  if (spec.Plan()) {
+    for (unsigned int r = 0; r <= spec.Plan()->LastRound(); ++r) {
+      options.messages_per_round = std::max(
+          options.messages_per_round, spec.Plan()->MessagesPerDestination(r));
+    }
+  }
+  return options;
+}
+
+// Determines the round deadline from the bounds flags. Without a max flag, the
+// upper bound is default_max. Neither bound is ever below the shortest deadline
+// that fits every attempt to send a message under the ack policy.
+generals::RoundDeadline GetRoundDeadline(
+    IntFlag& min_timeout, IntFlag& max_timeout, const generals::AckPolicy& ack,
+    std::chrono::microseconds default_max = generals::kRoundTimeout) {
+  std::chrono::microseconds floor = generals::MinRoundTimeout(ack);
+  std::chrono::microseconds min = floor;
+  std::chrono::microseconds max = default_max;
+  if (min_timeout) min = std::chrono::milliseconds{args::get(min_timeout)};
+  if (max_timeout) {
+    max = std::chrono::milliseconds{args::get(max_timeout)};
+  } else {
+    max = std::max(max, min);
+  }
+  if (min.count() > 0 && min < floor && min <= max) {
+    LOG(INFO) << "Raising the round timeout bounds to at least "
+              << floor.count() << "us, the time every send attempt may take\n";
+    min = floor;
+    max = std::max(max, floor);
+  }
+  try {
+    return generals::RoundDeadline(min, max);
+  } catch (const std::invalid_argument& e) {
+    throw args::ValidationError(e.what());
+  }
+}
+
+// Determines how long to keep sending after deciding from the provided
+// deadline flag, if any.
+std::experimental::optional<std::chrono::microseconds> GetSendDeadline(
+    IntFlag& deadline, const std::string& name) {
+  if (!deadline) {
+    return {};
+  }
+  if (args::get(deadline) <= 0) {
+    throw args::ValidationError(name + " must be positive");
+  }
+  return std::chrono::microseconds{
+      std::chrono::milliseconds{args::get(deadline)}};
+}
+
+// Prints the capacity plan of process_num processes tolerating faulty ones (see
+// PlanCapacity), and exits with an error if a round can not finish in time.
+void PrintCapacityPlan(int process_num, int faulty, StringFlag& protocol,
+                       bool relay_once, size_t value_size, IntFlag& rtt,
+                       IntFlag& max_round_timeout) {
+  if (process_num < 2) {
+    throw args::ValidationError("plan needs at least 2 processes");
+  }
+  ValidateFaultyCount(faulty);
+  auto spec = GetProtocol(process_num, protocol, faulty, relay_once);
+  if (!spec.Plan()) {
+    throw args::ValidationError(
+        "only signed messages relaying every message can be planned");
+  }
+
+  generals::CapacityOptions options;
+  options.rtt = generals::kDefaultPlanRtt;
+  if (rtt) {
+    if (args::get(rtt) <= 0) {
+      throw args::ValidationError("plan_rtt must be positive");
+    }
+    options.rtt = std::chrono::microseconds{args::get(rtt)};
+  }
+  options.round_timeout = generals::kRoundTimeout;
+  if (max_round_timeout) {
+    options.round_timeout =
+        std::chrono::milliseconds{args::get(max_round_timeout)};
+  }
+
+  std::vector<generals::RoundCapacity> rounds;
+  try {
+    generals::RoundPlan plan(process_num, spec.LastRound(), value_size);
+    rounds = generals::PlanCapacity(plan, options);
+  } catch (const std::overflow_error& e) {
+    throw args::ValidationError("too many messages per round to plan");
+  }
+
+  std::cout << "Capacity plan for " << process_num << " processes, " << faulty
+            << " of them faulty, with a round trip time of "
+            << options.rtt.count() << "us and a round timeout of "
+            << options.round_timeout.count() << "us:\n";
+  size_t peak_memory = 0;
+  for (auto const& c : rounds) {
+    if (c.round == 0) {
+      std::cout << "Round 0 commander: " << c.commander << "\n";
+    }
+    std::cout << "Round " << c.round << " lieutenant: " << c.lieutenant
+              << "\n";
+    peak_memory = std::max(peak_memory, c.lieutenant.memory_bytes);
+  }
+  std::cout << "Peak lieutenant memory: " << peak_memory << " bytes"
+            << std::endl;
+
+  try {
+    generals::CheckCapacity(rounds, options);
+  } catch (const std::invalid_argument& e) {
+    throw args::ValidationError(e.what());
+  }
+}
+
+// Determines the logging level from the provided flags.
+logging::Level GetLogLevel(bool verbose, StringFlag& log_level) {
+  if (verbose && log_level) {
+    throw args::ValidationError(
+        "verbose and log_level can not be provided together");
+  }
+  if (verbose) {
+    return logging::Level::DEBUG;
+  }
+  if (!log_level) {
+    return logging::Level::OFF;
+  }
+  try {
+    return logging::StringToLevel(args::get(log_level));
+  } catch (const std::invalid_argument& e) {
+    throw args::ValidationError(e.what());
+  }
+}
+
+// Starts tracing the process to the file at the provided path.
+void OpenTrace(const std::string& path, IntFlag& events,
+               unsigned int process_id) {
+  size_t capacity = tracing::kDefaultTraceEvents;
+  if (events) {
+    if (args::get(events) <= 0) {
+      throw args::ValidationError("trace_events must be positive");
+    }
+    capacity = args::get(events);
+  }
+  tracing::trace.Open(path, capacity, process_id);
+}
+
+// Prints the latencies observed by our process to stderr.
+void PrintLatencies(int id, const generals::RoundLatencies& latencies) {
+  std::cerr << id << ": Latencies:\n" << latencies << std::flush;
+}
+
+// Writes the transport stats of the general to the file at the provided path.
+void WriteTransportStats(const generals::General& general,
+                         const std::string& path) {
+  std::ofstream file(path);
+  general.WriteTransportStats(file);
+  if (!file) {
+    throw std::runtime_error("could not write transport stats to " + path);
+  }
+}
+
+// Prints the value that our process decided upon to stdout.
+void PrintValue(int id, const msg::Value& decision) {
+  std::cout << id << ": Agreed on " << msg::ValueString(decision) << std::endl;
+}
+
+// Prints the values that our process decided upon in each instance to stdout.
+void PrintValues(int id, const std::vector<msg::Value>& decisions) {
+  for (size_t inst = 0; inst < decisions.size(); ++inst) {
+    std::cout << id << ": Instance " << inst << " agreed on "
+              << msg::ValueString(decisions[inst]) << "\n";
+  }
+  std::cout << std::flush;
 }
 
 int main(int argc, const char** argv) {
@@ -230,24 +630,77 @@ int main(int argc, const char** argv) {
   IntFlag faulty(parser, "faulty", faulty_desc, {'f', "faulty"});
   IntFlag cmdr_id(parser, "commander_id", cmdr_id_desc, {'C', "commander_id"});
   StringFlag order(parser, "order", order_desc, {'o', "order"});
+  StringFlag value(parser, "value", value_desc, {'V', "value"});
+  StringFlag value_file(parser, "value_file", value_file_desc,
+                        {"value_file"});
   StringFlagList malicious(parser, "malicious", malicious_desc,
                            {'m', "malicious"});
   IntFlag id(parser, "id", id_desc, {'i', "id"});
+  IntFlag instances(parser, "instances", instances_desc, {'n', "instances"});
+  IntFlag waves(parser, "waves", waves_desc, {'w', "waves"});
+  args::Flag pipeline(parser, "pipeline", pipeline_desc, {"pipeline"});
+  args::Flag relay_once(parser, "relay_once", relay_once_desc,
+                        {"relay_once"});
+  StringFlag protocol(parser, "protocol", protocol_desc, {'P', "protocol"});
+  StringFlag keys(parser, "keys", keys_desc, {'k', "keys"});
+  StringFlag generate_keys(parser, "generate_keys", generate_keys_desc,
+                           {"generate_keys"});
+  IntFlag min_round_timeout(parser, "min_round_timeout",
+                            min_round_timeout_desc, {"min_round_timeout"});
+  IntFlag max_round_timeout(parser, "max_round_timeout",
+                            max_round_timeout_desc, {"max_round_timeout"});
+  args::Flag calibrate(parser, "calibrate", calibrate_desc, {"calibrate"});
+  IntFlag calibration_pings(parser, "calibration_pings",
+                            calibration_pings_desc, {"calibration_pings"});
+  args::ValueFlag<double> target_success(
+      parser, "target_success", target_success_desc, {"target_success"});
+  IntFlag delivery_deadline(parser, "delivery_deadline",
+                            delivery_deadline_desc, {"delivery_deadline"});
+  IntFlag drain_deadline(parser, "drain_deadline", drain_deadline_desc,
+                         {"drain_deadline"});
+  IntFlag plan(parser, "plan", plan_desc, {"plan"});
+  IntFlag plan_rtt(parser, "plan_rtt", plan_rtt_desc, {"plan_rtt"});
+  args::Flag latencies(parser, "latencies", latencies_desc, {"latencies"});
+  StringFlag transport_stats(parser, "transport_stats", transport_stats_desc,
+                             {"transport_stats"});
+  StringFlag trace(parser, "trace", trace_desc, {"trace"});
+  IntFlag trace_events(parser, "trace_events", trace_events_desc,
+                       {"trace_events"});
+  StringFlag analyze_trace(parser, "analyze_trace", analyze_trace_desc,
+                           {"analyze_trace"});
   args::Flag verbose(parser, "verbose", verbose_desc, {'v', "verbose"});
+  StringFlag log_level(parser, "log_level", log_level_desc, {"log_level"});
 
   try {
     parser.ParseCLI(argc, argv);
 
     // Set up logging.
-    logging::out.enable(verbose);
+    logging::out.SetLevel(GetLogLevel(verbose, log_level));
+
+    // Planning capacity is all there is to do if requested, and needs no
+    // hostfile.
+    if (plan) {
+      if (!faulty) throw args::UsageError("--faulty is a required flag");
+      size_t value_size = msg::OrderValue(msg::Order::ATTACK).size();
+      if (value || value_file) {
+        value_size = ValidateValue(order, value, value_file, true)->size();
+      }
+      PrintCapacityPlan(args::get(plan), args::get(faulty), protocol,
+                        args::get(relay_once), value_size, plan_rtt,
+                        max_round_timeout);
+      return 0;
+    }
+
+    // Analyzing a trace is all there is to do if requested.
+    if (analyze_trace) {
+      std::cout << generals::AnalyzeTrace(args::get(analyze_trace))
+                << std::flush;
+      return 0;
+    }
 
     // Check required fields.
     if (!hostfile) throw args::UsageError("--hostfile is a required flag");
-    if (!faulty) throw args::UsageError("--faulty is a required flag");
-    if (!cmdr_id) throw args::UsageError("--commander_id is a required flag");
     auto hostfile_val = args::get(hostfile);
-    auto faulty_val = args::get(faulty);
-    auto commander_id_val = args::get(cmdr_id);
 
     // Get the default process port, if one is supplied.
     std::experimental::optional<unsigned short> default_port;
@@ -258,6 +711,17 @@ int main(int argc, const char** argv) {
     // Create the process list from the hostfile.
     auto processes = GetProcesses(hostfile_val, default_port);
 
+    // Generating keys is all there is to do if requested.
+    if (generate_keys) {
+      generals::GenerateKeyFiles(args::get(generate_keys), processes.size());
+      return 0;
+    }
+
+    if (!faulty) throw args::UsageError("--faulty is a required flag");
+    if (!cmdr_id) throw args::UsageError("--commander_id is a required flag");
+    auto faulty_val = args::get(faulty);
+    auto commander_id_val = args::get(cmdr_id);
+
     // Determine the current process's ID.
     int my_id;
     if (id) {
@@ -268,32 +732,122 @@ int main(int argc, const char** argv) {
     }
     auto server_port = processes.at(my_id).port();
 
-    // Validate commander_id and faulty count flags.
+    // Validate commander_id and faulty count flags, and determine the protocol
+    // to run.
     ValidateCommanderId(processes, commander_id_val);
-    ValidateFaultyCount(processes, faulty_val);
+    ValidateFaultyCount(faulty_val);
+    auto spec = GetProtocol(processes.size(), protocol, faulty_val,
+                            args::get(relay_once));
+    if (spec.Plan()) {
+      LOG(INFO) << "Round plan: " << *spec.Plan() << "\n";
+    }
 
-    // Determine if the current process is the commander, and if so, what order
+    // Determine if the current process is the commander, and if so, what value
     // they should use.
     bool is_commander = my_id == commander_id_val;
-    auto order_val = ValidateOrder(order, is_commander);
+    auto value_val = ValidateValue(order, value, value_file, is_commander);
 
     // Determine which malicious behavior this process will exhibit.
     generals::MaliciousBehavior behavior =
         GetMaliciousBehavior(malicious, is_commander);
 
-    // Create the General depending on it is the Commander or a Lieutenant.
-    std::unique_ptr<generals::General> general;
+    // Set up message and link authentication if requested.
+    std::shared_ptr<const generals::MessageAuth> auth;
+    udp::LinkAuthPtr link_auth;
+    unsigned int process_id = is_commander ? 0 : my_id;
+    if (keys) {
+      auto key_set = GetKeys(processes, args::get(keys), commander_id_val);
+      auth = std::make_shared<generals::MessageAuth>(
+          process_id, key_set.signing, key_set.verifying);
+      link_auth = std::make_shared<udp::LinkAuth>(process_id, key_set.shared);
+    }
+    if (trace) OpenTrace(args::get(trace), trace_events, process_id);
+
+    // Determine how long to wait for acknowledgements and rounds, measuring
+    // the network first if requested.
+    generals::AckPolicy ack = generals::kDefaultAckPolicy;
+    std::chrono::microseconds max_round = generals::kRoundTimeout;
+    if (calibrate) {
+      auto options = GetCalibrationOptions(spec, faulty_val, calibration_pings,
+                                           target_success);
+      auto calibration = generals::Calibrate(processes, process_id,
+                                             server_port, link_auth, options);
+      ack = calibration.ack;
+      max_round = calibration.round_timeout;
+    }
+    auto deadline =
+        GetRoundDeadline(min_round_timeout, max_round_timeout, ack, max_round);
+
+    // Determine how many agreement instances to run, and when.
+    int instances_val = 1;
+    if (instances) {
+      instances_val = args::get(instances);
+      ValidateInstances(instances_val);
+    }
+    int waves_val = 1;
+    if (waves) {
+      waves_val = args::get(waves);
+      ValidateWaves(waves_val);
+    }
+    generals::Schedule schedule(instances_val, waves_val, spec.LastRound(),
+                                args::get(pipeline));
+    if (schedule.Instances() > 1 && latencies) {
+      throw args::ValidationError(
+          "--latencies only applies to a single instance");
+    }
+    if (schedule.Instances() > 1 && transport_stats) {
+      throw args::ValidationError(
+          "--transport_stats only applies to a single instance");
+    }
+
+    // Run many instances at once through an Engine if requested.
+    if (schedule.Instances() > 1) {
+      std::unique_ptr<generals::Engine> engine;
+      if (is_commander) {
+        auto values = std::vector<msg::Value>(schedule.Instances(), *value_val);
+        engine = std::make_unique<generals::CommanderEngine>(
+            processes, faulty_val, values, behavior, schedule, auth, link_auth,
+            ack);
+      } else {
+        engine = std::make_unique<generals::LieutenantEngine>(
+            processes, my_id, server_port, faulty_val, behavior, schedule,
+            spec, auth, link_auth, deadline, ack);
+      }
+
+      auto decisions = engine->DecideAll();
+      PrintValues(my_id, decisions);
+      return 0;
+    }
+
+    // The Commander prints its decision right away, and then waits for its
+    // orders to be delivered before exiting.
     if (is_commander) {
-      general = std::make_unique<generals::Commander>(processes, faulty_val,
-                                                      *order_val, behavior);
-    } else {
-      general = std::make_unique<generals::Lieutenant>(
-          processes, my_id, server_port, faulty_val, behavior);
+      generals::Commander commander(processes, faulty_val, *value_val,
+                                    behavior, auth, link_auth, ack);
+      auto decision =
+          commander.DecideAsync(GetSendDeadline(delivery_deadline,
+                                                "delivery_deadline"));
+      PrintValue(my_id, decision.value);
+      decision.delivery.wait();
+      if (latencies) PrintLatencies(my_id, commander.Latencies());
+      if (transport_stats) {
+        WriteTransportStats(commander, args::get(transport_stats));
+      }
+      return 0;
     }
 
-    // Run the algorithm by calling Decide() and print the results.
-    msg::Order decision = general->Decide();
-    PrintOrder(my_id, decision);
+    // Run the algorithm by calling Decide() and print the results, and then
+    // finish relaying the messages of the last round before exiting.
+    generals::Lieutenant lieutenant(processes, my_id, server_port, faulty_val,
+                                    behavior, spec, auth, link_auth, deadline,
+                                    ack);
+    msg::Value decision = lieutenant.Decide();
+    PrintValue(my_id, decision);
+    lieutenant.Drain(GetSendDeadline(drain_deadline, "drain_deadline"));
+    if (latencies) PrintLatencies(my_id, lieutenant.Latencies());
+    if (transport_stats) {
+      WriteTransportStats(lieutenant, args::get(transport_stats));
+    }
   } catch (const args::Help) {
     std::cout << parser;
     return 0;
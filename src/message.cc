@@ -1,5 +1,7 @@
 #include "message.h"
 
+#include "sha256.h"
+
 namespace msg {
 
 Order StringToOrder(std::string str) {
@@ -21,6 +23,28 @@ std::string OrderString(Order o) {
   }
 }
 
+Value OrderValue(Order o) {
+  if (o == Order::NO_ORDER) {
+    throw std::invalid_argument("NO_ORDER has no value");
+  }
+  return OrderString(o);
+}
+
+std::experimental::optional<Order> ValueOrder(const Value& v) {
+  if (v == OrderString(Order::RETREAT)) return Order::RETREAT;
+  if (v == OrderString(Order::ATTACK)) return Order::ATTACK;
+  return {};
+}
+
+std::string ValueString(const Value& v) {
+  auto order = ValueOrder(v);
+  if (order) {
+    return OrderString(*order);
+  }
+  return "value " + crypto::DigestString(crypto::Hash(v)).substr(0, 16) +
+         " (" + std::to_string(v.size()) + " bytes)";
+}
+
 bool operator<(const Message& lhs, const Message& rhs) {
   if (lhs.round != rhs.round) {
     return lhs.round < rhs.round;
@@ -28,11 +52,12 @@ bool operator<(const Message& lhs, const Message& rhs) {
   if (lhs.ids != rhs.ids) {
     return lhs.ids < rhs.ids;
   }
-  return lhs.order < rhs.order;
+  return lhs.value < rhs.value;
 }
 
 std::ostream& operator<<(std::ostream& o, const Message& m) {
-  o << "{round: " << m.round << ", order: " << OrderString(m.order)
+  o << "{round: " << m.round << ", order: "
+    << (m.value ? ValueString(*m.value) : OrderString(Order::NO_ORDER))
     << ", ids: <";
   for (size_t i = 0; i < m.ids.size(); ++i) {
     if (i > 0) o << ' ';
@@ -2,12 +2,28 @@
 #define MESSAGE_H_
 
 #include <exception>
+#include <experimental/optional>
 #include <iostream>
 #include <string>
 #include <vector>
 
 const uint32_t kByzantineMessageType = 1;
 const uint32_t kAckType = 2;
+const uint32_t kBatchMessageType = 3;
+const uint32_t kBatchAckType = 4;
+const uint32_t kValueMessageType = 5;
+const uint32_t kDoneType = 6;
+const uint32_t kAuthMessageType = 7;
+const uint32_t kPingType = 8;
+const uint32_t kPongType = 9;
+const uint32_t kHelloType = 10;
+const uint32_t kReadyType = 11;
+
+// The value_size of a message that carries no value (see ValueMessage).
+const uint32_t kNoValue = 0xffffffff;
+// The elapsed_us of an acknowledgement from a process that is not in the
+// acknowledged round (see Ack).
+const uint32_t kNotInRound = 0xffffffff;
 
 namespace msg {
 
@@ -19,18 +35,130 @@ typedef struct {
   uint32_t type;   // Must be equal to 1
   uint32_t size;   // size of message in bytes
   uint32_t round;  // round number
+  uint32_t seq;    // sequence number of the message (see AckId)
   uint32_t order;  // the order (retreat = 0, attack = 1, no order = 2)
   uint32_t ids[];  // id’s of the senders of this message
 } ByzantineMessage;
 
 // Ack is the wire format of an acknowledgement message used to provided
-// reliable communication.
+// reliable communication. It echoes the round and sequence number of the
+// acknowledged datagram (see AckId), so that it is never taken for the
+// acknowledgement of another one. It also tells the sender how long the
+// acknowledging process held the message, and how long ago it started the
+// round, so that Lieutenants can align their rounds (see RoundSkew).
 typedef struct {
-  uint32_t type;   // Must be equal to 2
-  uint32_t size;   // size of message in bytes
-  uint32_t round;  // round number
+  uint32_t type;        // Must be equal to 2
+  uint32_t size;        // size of message in bytes
+  uint32_t round;       // round number of the acknowledged datagram
+  uint32_t seq;         // sequence number of the acknowledged datagram
+  uint32_t hold_us;     // microseconds between receiving and acknowledging
+  uint32_t elapsed_us;  // microseconds since the round started, or kNotInRound
 } Ack;
 
+// ValueMessage is the wire format of a message carrying an opaque value instead
+// of an Order. The ids are followed by value_size bytes of the value, unless
+// value_size is kNoValue, in which case the message carries no value (like a
+// NO_ORDER ByzantineMessage).
+typedef struct {
+  uint32_t type;        // Must be equal to 5
+  uint32_t size;        // size of message in bytes
+  uint32_t round;       // round number
+  uint32_t seq;         // sequence number of the message (see AckId)
+  uint32_t id_count;    // number of ids following the header
+  uint32_t value_size;  // size of the value following the ids
+  uint32_t ids[];       // id’s of the senders of this message
+} ValueMessage;
+
+// AuthMessage is the wire format of a message carrying authenticators (see
+// MessageAuth). Like in a ValueMessage, the ids are followed by the value of
+// the message, which is followed by digest_size bytes of the digest of the
+// value it was relayed without, if any, and auth_count authenticators of
+// auth_size bytes each, one per hop.
+typedef struct {
+  uint32_t type;         // Must be equal to 7
+  uint32_t size;         // size of message in bytes
+  uint32_t round;        // round number
+  uint32_t seq;          // sequence number of the message (see AckId)
+  uint32_t id_count;     // number of ids following the header
+  uint32_t value_size;   // size of the value following the ids, or kNoValue
+  uint32_t digest_size;  // size of the digest following the value
+  uint32_t auth_count;   // number of authenticators following the digest
+  uint32_t auth_size;    // size of each authenticator
+  uint32_t ids[];        // id’s of the senders of this message
+} AuthMessage;
+
+// Done is the wire format of a marker a Lieutenant sends to every other
+// Lieutenant once it has sent all of its messages for a round, used when
+// relaying each value only once. It is acknowledged like a message.
+typedef struct {
+  uint32_t type;    // Must be equal to 6
+  uint32_t size;    // size of message in bytes
+  uint32_t round;   // round number
+  uint32_t sender;  // id of the Lieutenant that is done
+} Done;
+
+// BatchMessage is the wire format of a datagram carrying messages for many
+// concurrent instances of the Byzantine Agreement Algorithm at once. The header
+// is followed by count BatchEntry structures, each of variable size.
+typedef struct {
+  uint32_t type;   // Must be equal to 3
+  uint32_t size;   // size of message in bytes
+  uint32_t round;   // round number
+  uint32_t seq;     // sequence number of the datagram within the round
+  uint32_t sender;  // id of the sender of the datagram
+  uint32_t flags;   // kBatchDone on the last datagram of the round
+  uint32_t count;   // number of entries following the header
+} BatchMessage;
+
+// Set on the last BatchMessage a process sends to another one in a round,
+// marking it done with the round (see Done).
+const uint32_t kBatchDone = 1 << 0;
+// Set on a BatchMessage whose entries carry authenticators.
+const uint32_t kBatchAuth = 1 << 1;
+
+// BatchEntry is the wire format of a single message within a BatchMessage. Like
+// in a ValueMessage, the ids are followed by the value of the message. If the
+// batch has the kBatchAuth flag, the value is followed by three more uint32_t,
+// the size of the digest, and the count and size of the authenticators, then
+// by the digest and the authenticators themselves (see AuthMessage).
+typedef struct {
+  uint32_t instance;    // the agreement instance the message belongs to
+  uint32_t id_count;    // number of ids following the entry
+  uint32_t value_size;  // size of the value following the ids, or kNoValue
+  uint32_t ids[];       // id’s of the senders of this message
+} BatchEntry;
+
+// BatchAck is the wire format of an acknowledgement of a BatchMessage. It
+// echoes both the round and sequence number so that it can never be mistaken
+// for the acknowledgement of another datagram. Its timing is that of an Ack.
+typedef struct {
+  uint32_t type;        // Must be equal to 4
+  uint32_t size;        // size of message in bytes
+  uint32_t round;       // round number
+  uint32_t seq;         // sequence number of the acknowledged datagram
+  uint32_t hold_us;     // microseconds between receiving and acknowledging
+  uint32_t elapsed_us;  // microseconds since the round started, or kNotInRound
+} BatchAck;
+
+// Ping is the wire format of a probe sent to measure the round trip time to a
+// process while calibrating timeouts (see Calibrate). It is answered right away
+// with the same message with type kPongType.
+typedef struct {
+  uint32_t type;    // Must be equal to 8, or 9 for the answer
+  uint32_t size;    // size of message in bytes
+  uint32_t seq;     // sequence number of the probe
+  uint32_t sender;  // id of the process that sent the probe
+} Ping;
+
+// Hello is the wire format of the message the Commander sends each Lieutenant
+// before round 0 to learn that it is listening (see WaitForReady). A Lieutenant
+// answers it with the same message with type kReadyType and its own id.
+typedef struct {
+  uint32_t type;    // Must be equal to 10, or 11 for the answer
+  uint32_t size;    // size of message in bytes
+  uint32_t sender;  // id of the process that sent the message
+} Hello;
+
 // Order is the type of order that the Generals are attempting to come to
 // a consensus on in the Byzantine Agreement Algorithm. RETREAT and ATTACK
 // are the two options, while NO_ORDER is used in empty messages where no Order
@@ -47,12 +175,45 @@ Order StringToOrder(std::string str);
 // Returns the string representation of the provided Order.
 std::string OrderString(Order o);
 
+// Value is the opaque payload that the Generals are attempting to come to a
+// consensus on, like a batch of client commands or its hash. An Order is the
+// special case of the value holding its string representation, so that a
+// single agreement can decide on many bits at once while orders keep working
+// as before.
+typedef std::string Value;
+
+// Returns the Value representing the provided Order, which must not be
+// NO_ORDER.
+Value OrderValue(Order o);
+// Returns the Order represented by the provided Value, if any. If the value is
+// not an Order, the return value will be absent.
+std::experimental::optional<Order> ValueOrder(const Value& v);
+// Returns a printable representation of the provided Value: the Order it
+// represents, or a digest of its bytes.
+std::string ValueString(const Value& v);
+
 // Message is a convenient representation of a Byzantine message. It should be
-// favored over ByzantineMessage for all uses except encoding and decoding.
+// favored over ByzantineMessage and ValueMessage for all uses except encoding
+// and decoding. A message without a value is "a message reporting that he will
+// not send such a message" (a NO_ORDER message).
 struct Message {
   unsigned int round;
-  Order order;
+  std::experimental::optional<Value> value;
   std::vector<unsigned int> ids;
+  // The authenticators of the hops of the message, if messages are
+  // authenticated (see MessageAuth).
+  std::vector<std::string> auth;
+  // The digest of the value an authenticated message was relayed without,
+  // which the authenticators of its hops cover (see MessageAuth). Empty if the
+  // message has a value, or never had one.
+  std::string value_digest;
+};
+
+// InstanceMessage is a Message tagged with the agreement instance it belongs
+// to, used when many instances share a transport.
+struct InstanceMessage {
+  unsigned int instance;
+  Message msg;
 };
 
 // Needed so that Message can be added to std::set.
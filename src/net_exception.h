@@ -46,6 +46,11 @@ class ReceiveException : public AbstractNetworkException {
   }
 };
 
+class TimerException : public AbstractNetworkException {
+ public:
+  TimerException() { stream_ << "Could not use deadline timer: " << errno; }
+};
+
 }  // namespace net
 
 #endif
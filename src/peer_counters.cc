@@ -0,0 +1,35 @@
+#include "peer_counters.h"
+
+#include <stdexcept>
+
+namespace generals {
+
+std::string RejectionString(Rejection r) {
+  switch (r) {
+    case Rejection::MALFORMED:
+      return "malformed";
+    case Rejection::ROUND:
+      return "round";
+    case Rejection::PATH:
+      return "path";
+    case Rejection::SENDER:
+      return "sender";
+    case Rejection::AUTH:
+      return "auth";
+    default:
+      throw std::invalid_argument("unexpected Rejection value");
+  }
+}
+
+PeerCounters::PeerCounters()
+    : datagrams_received(0),
+      bytes_received(0),
+      acks_sent(0),
+      retransmits(0),
+      give_ups(0),
+      duplicates(0),
+      late(0) {
+  for (auto& r : rejected) r = 0;
+}
+
+}  // namespace generals
@@ -0,0 +1,57 @@
+#ifndef PEER_COUNTERS_H_
+#define PEER_COUNTERS_H_
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+namespace generals {
+
+// The reasons a Lieutenant rejects a datagram as invalid.
+enum class Rejection {
+  // It could not be decoded.
+  MALFORMED,
+  // It is from after the last round.
+  ROUND,
+  // The protocol does not expect its path.
+  PATH,
+  // It was not sent by the process it claims to be from.
+  SENDER,
+  // A hop of it is not authentic.
+  AUTH,
+};
+const size_t kRejections = 5;
+
+// Returns the string representation of the provided Rejection.
+std::string RejectionString(Rejection r);
+
+// Counts what a General exchanged with a single peer on top of the datagrams of
+// its udp::Client, so that a slow peer can be told apart from a lossy or a
+// faulty one. Updated by the listener and the sender threads at once.
+struct PeerCounters {
+  PeerCounters();
+
+  // Messages and markers received from the peer that passed validation.
+  std::atomic<uint64_t> datagrams_received;
+  std::atomic<uint64_t> bytes_received;
+  std::atomic<uint64_t> acks_sent;
+  // Attempts to send a datagram to the peer after the first.
+  std::atomic<uint64_t> retransmits;
+  // Datagrams that were never acknowledged after every attempt.
+  std::atomic<uint64_t> give_ups;
+  // Messages and markers received again in the same round, which the protocol
+  // ignores.
+  std::atomic<uint64_t> duplicates;
+  // Messages and markers that arrived after their round ended.
+  std::atomic<uint64_t> late;
+  // Datagrams rejected as invalid, indexed by Rejection.
+  std::array<std::atomic<uint64_t>, kRejections> rejected;
+
+  // Counts a datagram rejected for the provided reason.
+  inline void Reject(Rejection r) { rejected[static_cast<size_t>(r)]++; }
+};
+
+}  // namespace generals
+
+#endif
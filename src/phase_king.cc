@@ -0,0 +1,124 @@
+#include "phase_king.h"
+
+namespace generals {
+
+bool PhaseKing::ValidMessage(const msg::Message& msg,
+                             unsigned int round) const {
+  // Invalid if the message is from after the last round.
+  if (round > LastRound(faulty_)) {
+    return false;
+  }
+  // Invalid if the message does not hold exactly the id of its sender.
+  if (msg.ids.size() != 1) {
+    return false;
+  }
+  unsigned int sender = msg.ids.front();
+  // Invalid if the first message is not from the General (pid 0).
+  if (round == 0) {
+    return sender == 0;
+  }
+  // Invalid if the sender is not another Lieutenant.
+  if (sender == 0 || sender == id_ || sender >= process_num_) {
+    return false;
+  }
+  // Invalid if the sender is not the king in the king's round.
+  if (KingRound(round) && sender != KingOf(round)) {
+    return false;
+  }
+  return true;
+}
+
+bool PhaseKing::Receive(msg::Message msg, unsigned int round) {
+  // Only handle the first message from each process.
+  if (!senders_this_round_.insert(msg.ids.front()).second) {
+    return false;
+  }
+
+  if (round == 0) {
+    if (msg.value) {
+      pref_ = *msg.value;
+    }
+  } else if (KingRound(round)) {
+    king_value_ = msg.value;
+  } else if (msg.value) {
+    Vote(*msg.value);
+  }
+  return RoundComplete(round);
+}
+
+bool PhaseKing::RoundComplete(unsigned int round) const {
+  if (round == 0) {
+    return !senders_this_round_.empty();
+  }
+  if (KingRound(round)) {
+    return id_ == KingOf(round) || !senders_this_round_.empty();
+  }
+  // Every Lieutenant but ourselves must have voted.
+  return senders_this_round_.size() == process_num_ - 2;
+}
+
+Outbox PhaseKing::NextRound(unsigned int round) {
+  senders_this_round_.clear();
+
+  msg::Value v;
+  if (KingRound(round)) {
+    // Determine the majority of the votes. Ties go to the smallest digest, but
+    // any choice would do.
+    majority_ = default_value_;
+    majority_count_ = 0;
+    for (auto const& tally : tallies_) {
+      if (tally.second.count > majority_count_) {
+        majority_ = tally.second.value;
+        majority_count_ = tally.second.count;
+      }
+    }
+    king_value_ = {};
+    if (id_ != KingOf(round)) {
+      return {};
+    }
+    king_value_ = majority_;
+    v = majority_;
+  } else {
+    // Start a new phase from the outcome of the previous one, if any.
+    if (round > 1) {
+      pref_ = PhaseOutcome();
+    }
+    tallies_.clear();
+    Vote(pref_);
+    v = pref_;
+  }
+
+  // Send the value to every other Lieutenant.
+  Outbox toSend;
+  for (unsigned int pid = 1; pid < process_num_; ++pid) {
+    if (pid != id_) {
+      toSend[pid].push_back(msg::Message{round, v, {id_}});
+    }
+  }
+  return toSend;
+}
+
+msg::Value PhaseKing::Decide() const { return PhaseOutcome(); }
+
+void PhaseKing::Vote(const msg::Value& v) {
+  auto& tally = tallies_[crypto::Hash(v)];
+  if (tally.count++ == 0) {
+    tally.value = v;
+  }
+}
+
+msg::Value PhaseKing::PhaseOutcome() const {
+  // Keep the majority if more than half of the Lieutenants plus faulty voted
+  // for it, because then every loyal Lieutenant has the same majority.
+  size_t lieutenants = process_num_ - 1;
+  if (2 * majority_count_ > lieutenants + 2 * faulty_) {
+    return majority_;
+  }
+  // Otherwise adopt the value of the king, unless it did not send one.
+  if (king_value_) {
+    return *king_value_;
+  }
+  return majority_;
+}
+
+}  // namespace generals
@@ -0,0 +1,117 @@
+#ifndef PHASE_KING_H_
+#define PHASE_KING_H_
+
+#include <experimental/optional>
+#include <map>
+#include <set>
+
+#include "message.h"
+#include "protocol.h"
+#include "sha256.h"
+
+namespace generals {
+
+// Holds the state of a single instance of the Phase King algorithm from the
+// point of view of a Lieutenant. The Commander sends its value in round 0,
+// which each Lieutenant adopts as its preference. The Lieutenants then run
+// faulty + 1 phases of two rounds each:
+//
+//  1. Every Lieutenant sends its preference to every other Lieutenant, and
+//     determines the value preferred by the most Lieutenants (its majority).
+//  2. The king of the phase, Lieutenant p in phase p, sends its majority to
+//     every other Lieutenant. A Lieutenant keeps its majority as its preference
+//     if more than half of the Lieutenants plus faulty preferred it, and adopts
+//     the king's value otherwise.
+//
+// Each Lieutenant decides on its preference after the last phase. At least one
+// of the faulty + 1 kings is loyal, after which all loyal Lieutenants share a
+// preference for good. This holds as long as fewer than a quarter of the
+// Lieutenants are faulty, and only needs O(n^2 * f) messages, each of them
+// carrying only the id of its sender.
+//
+// Values are tracked by digest, like with SignedMessages.
+class PhaseKing : public Protocol {
+ public:
+  PhaseKing(size_t process_num, unsigned int id, unsigned int faulty,
+            msg::Value default_value = msg::OrderValue(msg::Order::RETREAT))
+      : process_num_(process_num),
+        id_(id),
+        faulty_(faulty),
+        default_value_(default_value),
+        pref_(default_value),
+        majority_(default_value),
+        majority_count_(0) {}
+
+  // Returns the last round of the algorithm given the number of faulty
+  // processes.
+  static inline unsigned int LastRound(unsigned int faulty) {
+    return 2 * faulty + 2;
+  }
+
+  // Validates that the message comes straight from a single process, and that
+  // this is the Commander in round 0 and the king of the phase in the second
+  // round of each phase.
+  bool ValidMessage(const msg::Message& msg, unsigned int round) const;
+
+  bool Receive(msg::Message msg, unsigned int round);
+
+  // Decides if the provided round is complete: once the Commander's value was
+  // received in round 0, once every other Lieutenant's preference was received
+  // in the first round of a phase, and once the king's value was received in
+  // the second one. The king itself completes its round right away.
+  bool RoundComplete(unsigned int round) const;
+
+  // Updates the preference at the beginning of a phase, or determines the
+  // majority at the beginning of the king's round, returning the preference or
+  // majority to send accordingly.
+  Outbox NextRound(unsigned int round);
+
+  // Decides on the preference resulting from the last phase. A Commander that
+  // is never heard from makes the default value, RETREAT unless specified
+  // otherwise, the initial preference.
+  msg::Value Decide() const;
+
+ private:
+  const size_t process_num_;
+  const unsigned int id_;
+  const unsigned int faulty_;
+  const msg::Value default_value_;
+
+  // The number of votes for a value in the first round of a phase.
+  struct Tally {
+    unsigned int count;
+    msg::Value value;
+  };
+
+  // The value this Lieutenant prefers in the current phase.
+  msg::Value pref_;
+  // The votes for each value this phase, keyed by digest, including our own.
+  std::map<crypto::Digest, Tally> tallies_;
+  // The value with the most votes this phase and its number of votes.
+  msg::Value majority_;
+  unsigned int majority_count_;
+  // The value sent by the king this phase, if any.
+  std::experimental::optional<msg::Value> king_value_;
+
+  // Determines if the provided round is the second round of a phase, in which
+  // only the king sends.
+  static inline bool KingRound(unsigned int round) {
+    return round > 0 && round % 2 == 0;
+  }
+  // Returns the king of the phase the provided king round belongs to.
+  static inline unsigned int KingOf(unsigned int round) { return round / 2; }
+
+  // Adds a vote for the value to this phase's tallies.
+  void Vote(const msg::Value& v);
+  // Returns the preference resulting from this phase.
+  msg::Value PhaseOutcome() const;
+
+  // Per-round variables:
+
+  // The processes heard from so far this round.
+  std::set<unsigned int> senders_this_round_;
+};
+
+}  // namespace generals
+
+#endif
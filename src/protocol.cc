@@ -0,0 +1,132 @@
+#include "protocol.h"
+
+#include <stdexcept>
+
+#include "fixed_signed_messages.h"
+#include "phase_king.h"
+#include "signed_messages.h"
+
+namespace generals {
+
+namespace {
+
+// Creates a FixedSignedMessages if the system has N processes and F faulty
+// ones. Otherwise, returns null.
+template <size_t N, size_t F>
+std::unique_ptr<Protocol> NewFixedIfSize(size_t process_num,
+                                         unsigned int faulty, unsigned int id) {
+  if (process_num != N || faulty != F) {
+    return nullptr;
+  }
+  return std::make_unique<FixedSignedMessages<N, F>>(id);
+}
+
+// Creates a FixedSignedMessages if the size of the system is one of those
+// compiled in: a few small common ones, and that of a fixed deployment given
+// at build time with GENERALS_FIXED_N and GENERALS_FIXED_F (see the Makefile).
+// Otherwise, returns null.
+std::unique_ptr<Protocol> NewFixedSignedMessages(size_t process_num,
+                                                 unsigned int faulty,
+                                                 unsigned int id) {
+  std::unique_ptr<Protocol> p;
+#if defined(GENERALS_FIXED_N) && defined(GENERALS_FIXED_F)
+  p = NewFixedIfSize<GENERALS_FIXED_N, GENERALS_FIXED_F>(process_num, faulty,
+                                                         id);
+  if (p) return p;
+#endif
+  p = NewFixedIfSize<4, 1>(process_num, faulty, id);
+  if (p) return p;
+  p = NewFixedIfSize<7, 2>(process_num, faulty, id);
+  return p;
+}
+
+}  // namespace
+
+ProtocolType StringToProtocolType(std::string str) {
+  if (str == "signed") return ProtocolType::SIGNED_MESSAGES;
+  if (str == "phase_king") return ProtocolType::PHASE_KING;
+  throw std::invalid_argument(
+      "protocol can be one of {\"signed\", \"phase_king\"}");
+}
+
+std::string ProtocolTypeString(ProtocolType t) {
+  switch (t) {
+    case ProtocolType::SIGNED_MESSAGES:
+      return "signed";
+    case ProtocolType::PHASE_KING:
+      return "phase_king";
+    default:
+      throw std::invalid_argument("unexpected ProtocolType value");
+  }
+}
+
+unsigned int ProtocolSpec::LastRound() const {
+  switch (type_) {
+    case ProtocolType::SIGNED_MESSAGES:
+      return faulty_ + 1;
+    case ProtocolType::PHASE_KING:
+      return PhaseKing::LastRound(faulty_);
+    default:
+      throw std::invalid_argument("unexpected ProtocolType value");
+  }
+}
+
+ProtocolSpec::ProtocolSpec(ProtocolType type, size_t process_num,
+                           unsigned int faulty, RelayMode relay_mode)
+    : type_(type),
+      process_num_(process_num),
+      faulty_(faulty),
+      relay_mode_(relay_mode) {
+  Validate();
+  if (type_ == ProtocolType::SIGNED_MESSAGES && relay_mode_ == RelayMode::ALL) {
+    try {
+      plan_ = std::make_shared<RoundPlan>(process_num_, LastRound(),
+                                          kMaxValueSize);
+    } catch (const std::overflow_error&) {
+      throw std::invalid_argument(
+          "too many messages per round to relay every message, try relaying "
+          "once");
+    }
+  }
+}
+
+void ProtocolSpec::Validate() const {
+  switch (type_) {
+    case ProtocolType::SIGNED_MESSAGES:
+      if (faulty_ + 2 > process_num_) {
+        throw std::invalid_argument(
+            "the total number of processes must be no less than (faulty + 2)");
+      }
+      return;
+    case ProtocolType::PHASE_KING:
+      if (relay_mode_ != RelayMode::ALL) {
+        throw std::invalid_argument(
+            "relaying once only applies to signed messages");
+      }
+      if (4 * faulty_ + 1 >= process_num_) {
+        throw std::invalid_argument(
+            "phase king needs more than (4 * faulty + 1) processes");
+      }
+      return;
+    default:
+      throw std::invalid_argument("unexpected ProtocolType value");
+  }
+}
+
+std::unique_ptr<Protocol> ProtocolSpec::New(unsigned int id) const {
+  switch (type_) {
+    case ProtocolType::SIGNED_MESSAGES:
+      if (relay_mode_ == RelayMode::ALL) {
+        auto fixed = NewFixedSignedMessages(process_num_, faulty_, id);
+        if (fixed) return fixed;
+      }
+      return std::make_unique<SignedMessages>(process_num_, id, plan_,
+                                              relay_mode_);
+    case ProtocolType::PHASE_KING:
+      return std::make_unique<PhaseKing>(process_num_, id, faulty_);
+    default:
+      throw std::invalid_argument("unexpected ProtocolType value");
+  }
+}
+
+}  // namespace generals
@@ -0,0 +1,142 @@
+#ifndef PROTOCOL_H_
+#define PROTOCOL_H_
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "message.h"
+#include "round_plan.h"
+
+namespace generals {
+
+// The maximum size of a value, chosen so that any message carrying one still
+// fits in a single UDP datagram.
+const size_t kMaxValueSize = 32768;
+
+// Holds the messages a process should send at the beginning of a round, keyed
+// by the destination process ID.
+typedef std::unordered_map<unsigned int, std::vector<msg::Message>> Outbox;
+
+// The state of a single instance of an agreement protocol from the point of
+// view of a Lieutenant. A protocol knows nothing about the network: a round
+// driver, like the Lieutenant or the LieutenantEngine, validates and hands it
+// the messages received in each round, asks it which messages to send at the
+// beginning of each round, and finally asks it for its decision. In every
+// protocol, the Commander only sends its value to each Lieutenant in round 0,
+// and the message sent by a process always ends with its own id.
+class Protocol {
+ public:
+  virtual ~Protocol() = default;
+
+  // Validates that the message makes sense for a message received during the
+  // provided round of the protocol. This does not check its sender, nor that
+  // the message is from the round the caller is in.
+  virtual bool ValidMessage(const msg::Message& msg,
+                            unsigned int round) const = 0;
+
+  // Handles a validated message received during the provided round. Returns
+  // whether the message completed the round, in which case the caller should
+  // move to the next one.
+  virtual bool Receive(msg::Message msg, unsigned int round) = 0;
+
+  // Handles a marker from Lieutenant pid saying that it has sent all of its
+  // messages for the provided round. Returns whether the marker completed the
+  // round. Only protocols that send done markers use them.
+  virtual bool ReceiveDone(unsigned int pid, unsigned int round) {
+    return false;
+  }
+
+  // Decides if the provided round is complete based on the messages received
+  // so far. A round may be complete without any message, if none are expected.
+  virtual bool RoundComplete(unsigned int round) const = 0;
+
+  // Moves to the provided round, returning the messages to send to other
+  // processes in it. When the protocol sends done markers, every process that
+  // needs to be marked done is present in the result, even with no messages.
+  // Clears all per-round state.
+  virtual Outbox NextRound(unsigned int round) = 0;
+
+  // Decides on a value based on the messages received over the course of the
+  // protocol.
+  virtual msg::Value Decide() const = 0;
+};
+
+// The agreement protocols a Lieutenant can run.
+enum class ProtocolType {
+  // Lamport, Shostak and Pease's algorithm with signed messages. Tolerates any
+  // number of faulty processes and takes faulty + 2 rounds.
+  SIGNED_MESSAGES,
+  // Berman, Garay and Perry's Phase King algorithm. Only needs a polynomial
+  // number of messages, but tolerates fewer than a quarter of the Lieutenants
+  // being faulty and takes 2 * faulty + 3 rounds.
+  PHASE_KING,
+};
+
+// Maps a string to a ProtocolType, throwing an exception if the string is
+// invalid.
+ProtocolType StringToProtocolType(std::string str);
+// Returns the string representation of the provided ProtocolType.
+std::string ProtocolTypeString(ProtocolType t);
+
+// Determines which messages a Lieutenant relays to other processes with signed
+// messages.
+enum class RelayMode {
+  // Relay every message received to every process not in its path, replacing
+  // values that were already seen with no value. Rounds complete once the
+  // number of messages given by the RoundPlan has been received.
+  ALL,
+  // Relay only messages that added a new value to the set of values seen, and
+  // nothing once two values have been seen (Dolev-Strong style). This needs
+  // O(n^2 * f) messages instead of O(n^(f+1)). Because the number of messages
+  // per round is not known up front, rounds complete once every other
+  // Lieutenant has marked itself done with the round.
+  ONCE,
+};
+
+// Describes the protocol that all processes agreed to run among process_num
+// processes, and creates the state of each instance of it. Throws an exception
+// if the protocol can not tolerate the faulty processes among them, or if the
+// system is too large to run it (see RoundPlan).
+class ProtocolSpec {
+ public:
+  ProtocolSpec(ProtocolType type, size_t process_num, unsigned int faulty,
+               RelayMode relay_mode = RelayMode::ALL);
+
+  inline ProtocolType Type() const { return type_; }
+  inline size_t Processes() const { return process_num_; }
+
+  // Returns the plan of every round shared by all instances, if the protocol
+  // has one: signed messages relaying every message. Otherwise, returns null.
+  inline std::shared_ptr<const RoundPlan> Plan() const { return plan_; }
+
+  // Returns the last round of an instance of the protocol, after which each
+  // Lieutenant decides.
+  unsigned int LastRound() const;
+
+  // Determines if Lieutenants mark themselves done with each round after
+  // sending their messages.
+  inline bool SendsDone() const {
+    return type_ == ProtocolType::SIGNED_MESSAGES &&
+           relay_mode_ == RelayMode::ONCE;
+  }
+
+  // Creates the state of a new instance of the protocol for process id.
+  std::unique_ptr<Protocol> New(unsigned int id) const;
+
+ private:
+  const ProtocolType type_;
+  const size_t process_num_;
+  const unsigned int faulty_;
+  const RelayMode relay_mode_;
+  std::shared_ptr<const RoundPlan> plan_;
+
+  // Validates that the protocol can tolerate the faulty processes, throwing an
+  // exception if it can not.
+  void Validate() const;
+};
+
+}  // namespace generals
+
+#endif
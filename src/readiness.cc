@@ -0,0 +1,110 @@
+#include "readiness.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+
+#include "log.h"
+#include "message.h"
+#include "thread.h"
+
+namespace generals {
+
+namespace {
+
+using std::chrono::microseconds;
+using std::chrono::steady_clock;
+
+// Encodes a Hello of the provided type.
+msg::Hello EncodeHello(uint32_t type, unsigned int sender) {
+  msg::Hello hello = {};
+  hello.type = htonl(type);
+  hello.size = htonl(sizeof(hello));
+  hello.sender = htonl(sender);
+  return hello;
+}
+
+// Determines if the buffer holds a Hello of the provided type.
+bool IsHello(uint32_t type, const char* buf, size_t n) {
+  if (n != sizeof(msg::Hello)) {
+    return false;
+  }
+  auto hello = reinterpret_cast<const msg::Hello*>(buf);
+  return ntohl(hello->type) == type;
+}
+
+}  // namespace
+
+bool AnswerHello(udp::ClientPtr client, const char* buf, size_t n,
+                 unsigned int id) {
+  if (!IsHello(kHelloType, buf, n)) {
+    return false;
+  }
+  auto ready = EncodeHello(kReadyType, id);
+  client->Send(reinterpret_cast<char*>(&ready), sizeof(ready));
+  return true;
+}
+
+std::experimental::optional<microseconds> WaitForReady(
+    const ProcessList& processes, unsigned int id, size_t quorum,
+    udp::LinkAuthPtr link_auth) {
+  auto start = steady_clock::now();
+  auto clients = ClientsForProcessList(processes, link_auth, kHelloInterval);
+
+  std::mutex mu;
+  std::condition_variable changed;
+  size_t ready = 0;
+  std::atomic<bool> stop{false};
+
+  // Greet every other process from its own thread until it answers, or we stop
+  // waiting for it.
+  threadutil::ThreadGroup greeters;
+  for (unsigned int pid = 0; pid < processes.size(); ++pid) {
+    if (pid == id) continue;
+    auto client = clients.at(processes[pid]);
+    greeters.AddThread([&, client, pid] {
+      auto hello = EncodeHello(kHelloType, id);
+      auto isReady = [](udp::ClientPtr _, char* buf, size_t n) {
+        return IsHello(kReadyType, buf, n) ? udp::ServerAction::Stop
+                                           : udp::ServerAction::Continue;
+      };
+      while (!stop) {
+        if (client->SendWithAck(reinterpret_cast<char*>(&hello), sizeof(hello),
+                                1, isReady)) {
+          std::lock_guard<std::mutex> lock(mu);
+          LOG(DEBUG) << "p" << pid << " ready after "
+                     << std::chrono::duration_cast<microseconds>(
+                            steady_clock::now() - start)
+                            .count()
+                     << "us\n";
+          ready++;
+          changed.notify_one();
+          return;
+        }
+      }
+    });
+  }
+
+  std::unique_lock<std::mutex> lock(mu);
+  bool reached = changed.wait_until(lock, start + kReadyTimeout,
+                                    [&] { return ready >= quorum; });
+  auto took =
+      std::chrono::duration_cast<microseconds>(steady_clock::now() - start);
+  size_t ready_now = ready;
+  lock.unlock();
+  stop = true;
+  greeters.JoinAll();
+
+  if (!reached) {
+    LOG(INFO) << "Only " << ready_now << " of the " << quorum
+              << " processes needed were ready after " << took.count()
+              << "us, starting anyway\n";
+    return {};
+  }
+  LOG(INFO) << "A quorum of " << ready_now << " of the "
+            << processes.size() - 1 << " other processes was ready after "
+            << took.count() << "us\n";
+  return took;
+}
+
+}  // namespace generals
@@ -0,0 +1,40 @@
+#ifndef READINESS_H_
+#define READINESS_H_
+
+#include <chrono>
+#include <experimental/optional>
+
+#include "general.h"
+#include "udp_conn.h"
+
+namespace generals {
+
+// How long the Commander waits for an answer to each hello before sending
+// another, short so that it learns quickly when a Lieutenant starts.
+const auto kHelloInterval = std::chrono::milliseconds{2};
+// How long the Commander waits for a quorum of Lieutenants to be ready before
+// starting anyway.
+const auto kReadyTimeout = std::chrono::seconds{10};
+
+// Answers the datagram with a ready message from process id if it is a hello,
+// returning whether it was. Lieutenants call this on every datagram they
+// receive, so that the Commander knows they are listening.
+bool AnswerHello(udp::ClientPtr client, const char* buf, size_t n,
+                 unsigned int id);
+
+// Sends hellos from process id to every other process until at least quorum of
+// them answer that they are ready, meaning that they are listening for the
+// messages of the algorithm, or kReadyTimeout passes. Logs when each process
+// became ready. Returns the time it took for the quorum to be ready, or an
+// absent value if it timed out.
+//
+// The Commander calls this before round 0, so that it neither spends the
+// attempts of its orders on Lieutenants that have not started yet, nor waits
+// for longer than it takes them to start.
+std::experimental::optional<std::chrono::microseconds> WaitForReady(
+    const ProcessList& processes, unsigned int id, size_t quorum,
+    udp::LinkAuthPtr link_auth);
+
+}  // namespace generals
+
+#endif
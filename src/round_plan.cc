@@ -0,0 +1,75 @@
+#include "round_plan.h"
+
+#include <limits>
+#include <stdexcept>
+
+#include "message.h"
+
+namespace generals {
+
+size_t CheckedMul(size_t a, size_t b) {
+  if (a != 0 && b > std::numeric_limits<size_t>::max() / a) {
+    throw std::overflow_error("size overflows");
+  }
+  return a * b;
+}
+
+size_t CheckedAdd(size_t a, size_t b) {
+  if (b > std::numeric_limits<size_t>::max() - a) {
+    throw std::overflow_error("size overflows");
+  }
+  return a + b;
+}
+
+RoundPlan::RoundPlan(size_t process_num, unsigned int last_round,
+                     size_t max_value_size)
+    : process_num_(process_num), last_round_(last_round) {
+  if (process_num < 2 || last_round >= process_num) {
+    throw std::invalid_argument(
+        "a round plan needs more processes than rounds");
+  }
+
+  size_t rounds = last_round + 1;
+  messages_.reserve(rounds);
+  per_peer_.reserve(rounds);
+  message_bytes_.reserve(rounds);
+  receive_bytes_.reserve(rounds);
+  send_bytes_.reserve(rounds);
+
+  for (unsigned int r = 0; r < rounds; ++r) {
+    if (r == 0) {
+      messages_.push_back(1);
+      per_peer_.push_back(1);
+    } else {
+      // A path of r + 1 ids has r Lieutenants after the Commander, chosen in
+      // order from the process_num - 2 Lieutenants other than ourselves. Those
+      // ending with a given sender choose the other r - 1 from the
+      // process_num - 3 Lieutenants left.
+      size_t choices = process_num - 1 - r;
+      messages_.push_back(CheckedMul(messages_[r - 1], choices));
+      per_peer_.push_back(r == 1 ? 1 : CheckedMul(per_peer_[r - 1], choices));
+    }
+
+    size_t id_bytes = CheckedMul(sizeof(uint32_t), r + 1);
+    size_t bytes = CheckedAdd(CheckedAdd(sizeof(msg::ValueMessage), id_bytes),
+                              max_value_size);
+    message_bytes_.push_back(bytes);
+    receive_bytes_.push_back(CheckedMul(messages_[r], bytes));
+    size_t sent = r == 0 ? 0 : CheckedMul(messages_[r - 1], Fanout(r));
+    send_bytes_.push_back(CheckedMul(sent, bytes));
+  }
+}
+
+std::ostream& operator<<(std::ostream& o, const RoundPlan& p) {
+  o << "{processes: " << p.Processes() << ", rounds: [";
+  for (unsigned int r = 0; r <= p.LastRound(); ++r) {
+    if (r > 0) o << ", ";
+    o << "{messages: " << p.Messages(r)
+      << ", per_sender: " << p.MessagesPerSender(r)
+      << ", receive_bytes: " << p.ReceiveBytes(r)
+      << ", send_bytes: " << p.SendBytes(r) << "}";
+  }
+  return o << "]}";
+}
+
+}  // namespace generals
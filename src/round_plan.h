@@ -0,0 +1,91 @@
+#ifndef ROUND_PLAN_H_
+#define ROUND_PLAN_H_
+
+#include <cstddef>
+#include <iostream>
+#include <vector>
+
+namespace generals {
+
+// Multiplies two sizes, throwing std::overflow_error if the product does not
+// fit in a size_t.
+size_t CheckedMul(size_t a, size_t b);
+// Adds two sizes, throwing std::overflow_error if the sum does not fit in a
+// size_t.
+size_t CheckedAdd(size_t a, size_t b);
+
+// Describes what a Lieutenant running the algorithm with signed messages, and
+// relaying every message, sends and receives in each round of a system of a
+// given size. The plan is built once at startup with overflow-checked
+// arithmetic, so that systems too large to count their messages are rejected
+// up front instead of silently never completing a round, and every query is a
+// table lookup.
+//
+// In round r > 0, a Lieutenant receives one message for every path of r + 1
+// distinct ids that starts with the Commander and excludes itself. Of those,
+// the paths ending with a given sender are the ones it expects from that
+// sender. It relays each of them in round r + 1 to the processes not in the
+// path.
+class RoundPlan {
+ public:
+  // Builds the plan for process_num processes up to and including last_round.
+  // Throws std::overflow_error if any count or byte budget for a message of
+  // up to max_value_size bytes does not fit in a size_t.
+  RoundPlan(size_t process_num, unsigned int last_round,
+            size_t max_value_size);
+
+  // Returns the number of processes.
+  inline size_t Processes() const { return process_num_; }
+  // Returns the last round of the plan.
+  inline unsigned int LastRound() const { return last_round_; }
+
+  // Returns the number of messages a Lieutenant expects in the round.
+  inline size_t Messages(unsigned int round) const {
+    return messages_[round];
+  }
+  // Returns the number of messages a Lieutenant expects from each other
+  // Lieutenant in the round, or from the Commander in round 0.
+  inline size_t MessagesPerSender(unsigned int round) const {
+    return per_peer_[round];
+  }
+  // Returns the number of messages a Lieutenant sends to each other Lieutenant
+  // in the round, which is the number it expects from each of them.
+  inline size_t MessagesPerDestination(unsigned int round) const {
+    return round == 0 ? 0 : per_peer_[round];
+  }
+  // Returns the number of processes each message received in the round before
+  // is relayed to in the round.
+  inline size_t Fanout(unsigned int round) const {
+    return round == 0 ? 0 : process_num_ - 1 - round;
+  }
+
+  // Returns the largest encoding of a message of the round with a value of
+  // max_value_size bytes.
+  inline size_t MaxMessageBytes(unsigned int round) const {
+    return message_bytes_[round];
+  }
+  // Returns the most bytes of messages a Lieutenant can receive in the round.
+  inline size_t ReceiveBytes(unsigned int round) const {
+    return receive_bytes_[round];
+  }
+  // Returns the most bytes of messages a Lieutenant can send in the round.
+  inline size_t SendBytes(unsigned int round) const {
+    return send_bytes_[round];
+  }
+
+ private:
+  const size_t process_num_;
+  const unsigned int last_round_;
+  std::vector<size_t> messages_;
+  std::vector<size_t> per_peer_;
+  std::vector<size_t> message_bytes_;
+  std::vector<size_t> receive_bytes_;
+  std::vector<size_t> send_bytes_;
+};
+
+// Allow streaming of RoundPlan on ostreams.
+std::ostream& operator<<(std::ostream& o, const RoundPlan& p);
+
+}  // namespace generals
+
+#endif
@@ -0,0 +1,101 @@
+#include "round_skew.h"
+
+#include <arpa/inet.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "message.h"
+
+namespace generals {
+
+namespace {
+
+using std::chrono::microseconds;
+using std::chrono::steady_clock;
+
+// Encodes the duration in network byte order, saturating it below kNotInRound.
+uint32_t WriteMicros(microseconds d) {
+  auto us = std::max<microseconds::rep>(d.count(), 0);
+  return htonl(std::min<microseconds::rep>(us, kNotInRound - 1));
+}
+
+}  // namespace
+
+AckTiming TimingForAck(steady_clock::time_point received,
+                       std::experimental::optional<steady_clock::time_point>
+                           round_start) {
+  auto now = steady_clock::now();
+  AckTiming timing;
+  timing.hold = std::chrono::duration_cast<microseconds>(now - received);
+  if (round_start) {
+    timing.elapsed =
+        std::chrono::duration_cast<microseconds>(now - *round_start);
+  }
+  return timing;
+}
+
+void WriteAckTiming(const AckTiming& timing, uint32_t* hold_us,
+                    uint32_t* elapsed_us) {
+  *hold_us = WriteMicros(timing.hold);
+  *elapsed_us =
+      timing.elapsed ? WriteMicros(*timing.elapsed) : htonl(kNotInRound);
+}
+
+AckTiming ReadAckTiming(uint32_t hold_us, uint32_t elapsed_us) {
+  AckTiming timing;
+  timing.hold = microseconds{ntohl(hold_us)};
+  if (ntohl(elapsed_us) != kNotInRound) {
+    timing.elapsed = microseconds{ntohl(elapsed_us)};
+  }
+  return timing;
+}
+
+void RoundSkew::StartRound(unsigned int round, steady_clock::time_point start) {
+  std::lock_guard<std::mutex> lock(mu_);
+  round_ = round;
+  start_ = start;
+  samples_.clear();
+}
+
+void RoundSkew::Sample(const udp::Client* peer, unsigned int round,
+                       steady_clock::time_point sent,
+                       steady_clock::time_point acked,
+                       const AckTiming& timing) {
+  if (!timing.elapsed) {
+    return;
+  }
+  auto rtt = std::chrono::duration_cast<microseconds>(acked - sent);
+  auto delay = std::max(rtt - timing.hold, microseconds{0});
+  if (delay >= max_delay_) {
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(mu_);
+  if (round != round_) {
+    return;
+  }
+  auto peer_start = acked - delay / 2 - *timing.elapsed;
+  auto offset = std::chrono::duration_cast<microseconds>(peer_start - start_);
+  auto it = samples_.find(peer);
+  if (it == samples_.end() || delay < it->second.delay) {
+    samples_[peer] = {delay, offset};
+  }
+}
+
+microseconds RoundSkew::Offset(microseconds limit) const {
+  std::vector<microseconds> offsets{microseconds{0}};
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    offsets.reserve(samples_.size() + 1);
+    for (auto const& sample : samples_) {
+      offsets.push_back(sample.second.offset);
+    }
+  }
+
+  auto median = offsets.begin() + offsets.size() / 2;
+  std::nth_element(offsets.begin(), median, offsets.end());
+  return std::min(std::max(*median, -limit), limit);
+}
+
+}  // namespace generals
@@ -0,0 +1,104 @@
+#ifndef ROUND_SKEW_H_
+#define ROUND_SKEW_H_
+
+#include <chrono>
+#include <experimental/optional>
+#include <mutex>
+#include <unordered_map>
+
+#include "udp_conn.h"
+
+namespace generals {
+
+// A round is moved by at most its deadline divided by kMaxSkewFraction to align
+// it with the other processes.
+const unsigned int kMaxSkewFraction = 2;
+
+// The timing an acknowledgement carries back to the sender of the datagram it
+// acknowledges, so that the sender can tell when the round of the acknowledging
+// process started (see RoundSkew).
+struct AckTiming {
+  // The time between receiving the datagram and sending the acknowledgement.
+  std::chrono::microseconds hold;
+  // The time since the acknowledging process started the acknowledged round,
+  // if it is in that round.
+  std::experimental::optional<std::chrono::microseconds> elapsed;
+};
+
+// Returns the timing of an acknowledgement sent now, for a datagram received
+// at the provided time by a process that started the acknowledged round at
+// round_start, if it is in that round.
+AckTiming TimingForAck(
+    std::chrono::steady_clock::time_point received,
+    std::experimental::optional<std::chrono::steady_clock::time_point>
+        round_start);
+
+// Encodes the timing as the network byte order hold_us and elapsed_us fields of
+// an acknowledgement, saturating durations that do not fit.
+void WriteAckTiming(const AckTiming& timing, uint32_t* hold_us,
+                    uint32_t* elapsed_us);
+// Decodes the timing from the network byte order hold_us and elapsed_us fields
+// of an acknowledgement.
+AckTiming ReadAckTiming(uint32_t hold_us, uint32_t elapsed_us);
+
+// Estimates how much earlier or later than ours the other processes started
+// the current round, so that a Lieutenant can end the round when the cluster
+// does instead of when its own clock says so. Lieutenants start the first
+// round whenever the order of the Commander reaches them, possibly after
+// retransmissions, so without it their rounds can be skewed by whole ack
+// timeouts.
+//
+// The estimate is NTP style and piggybacked on the acknowledgements of the
+// messages a Lieutenant sends anyway. A message sent at t1 is acknowledged at
+// t4 by a peer that held it for h (see AckTiming), so the network delay is
+// d = (t4 - t1) - h, and the peer sent the acknowledgement at about
+// t4 - d / 2 on our clock. The peer started the round elapsed before that,
+// which only involves durations, so the steady clocks of processes never need
+// to agree. Like the clock filter of NTP, only the sample with the lowest
+// delay is kept for each peer, and samples that may time a retransmission are
+// discarded.
+//
+// All methods are thread safe, since samples come from the sender threads.
+class RoundSkew {
+ public:
+  // Creates an estimator that discards samples with a delay of max_delay or
+  // more, which may time a retransmission.
+  explicit RoundSkew(std::chrono::microseconds max_delay)
+      : max_delay_(max_delay), round_(0) {}
+
+  // Starts the provided round at the provided time, forgetting the samples of
+  // the round before it.
+  void StartRound(unsigned int round,
+                  std::chrono::steady_clock::time_point start);
+
+  // Records the acknowledgement by peer, at acked, of a datagram from the
+  // provided round sent at sent. Samples from other rounds are discarded.
+  void Sample(const udp::Client* peer, unsigned int round,
+              std::chrono::steady_clock::time_point sent,
+              std::chrono::steady_clock::time_point acked,
+              const AckTiming& timing);
+
+  // Returns the median of the start of the current round at every process
+  // sampled and ours, relative to ours, clamped to [-limit, limit]. Taking the
+  // median keeps faulty processes from moving it outside the range of the
+  // loyal ones, as long as they are a minority of the sampled processes.
+  std::chrono::microseconds Offset(std::chrono::microseconds limit) const;
+
+ private:
+  const std::chrono::microseconds max_delay_;
+
+  mutable std::mutex mu_;
+  unsigned int round_;
+  std::chrono::steady_clock::time_point start_;
+
+  // The lowest delay sample of a peer this round.
+  struct PeerSample {
+    std::chrono::microseconds delay;
+    std::chrono::microseconds offset;
+  };
+  std::unordered_map<const udp::Client*, PeerSample> samples_;
+};
+
+}  // namespace generals
+
+#endif
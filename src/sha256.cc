@@ -0,0 +1,148 @@
+#include "sha256.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+namespace crypto {
+
+namespace {
+
+const uint32_t kRoundConstants[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+    0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+    0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+    0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+    0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+    0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+inline uint32_t Rotr(uint32_t x, unsigned int n) {
+  return (x >> n) | (x << (32 - n));
+}
+
+}  // namespace
+
+Sha256::Sha256() : block_len_(0), total_len_(0) {
+  state_[0] = 0x6a09e667;
+  state_[1] = 0xbb67ae85;
+  state_[2] = 0x3c6ef372;
+  state_[3] = 0xa54ff53a;
+  state_[4] = 0x510e527f;
+  state_[5] = 0x9b05688c;
+  state_[6] = 0x1f83d9ab;
+  state_[7] = 0x5be0cd19;
+}
+
+void Sha256::Update(const void* data, size_t n) {
+  const uint8_t* in = static_cast<const uint8_t*>(data);
+  total_len_ += n;
+
+  // Top off a partially filled block first.
+  if (block_len_ > 0) {
+    size_t take = std::min(n, sizeof(block_) - block_len_);
+    memcpy(block_ + block_len_, in, take);
+    block_len_ += take;
+    in += take;
+    n -= take;
+    if (block_len_ < sizeof(block_)) {
+      return;
+    }
+    Compress(block_);
+    block_len_ = 0;
+  }
+
+  // Compress full blocks straight out of the input.
+  for (; n >= sizeof(block_); in += sizeof(block_), n -= sizeof(block_)) {
+    Compress(in);
+  }
+
+  memcpy(block_, in, n);
+  block_len_ = n;
+}
+
+Digest Sha256::Finish() {
+  uint64_t bit_len = total_len_ * 8;
+
+  // Pad with a single 1 bit, zeros and the message length in bits.
+  uint8_t pad[72] = {0x80};
+  size_t pad_len = (block_len_ < 56 ? 56 : 120) - block_len_;
+  for (int i = 0; i < 8; ++i) {
+    pad[pad_len + i] = static_cast<uint8_t>(bit_len >> (56 - 8 * i));
+  }
+  Update(pad, pad_len + 8);
+
+  Digest d;
+  for (int i = 0; i < 8; ++i) {
+    d[4 * i] = static_cast<uint8_t>(state_[i] >> 24);
+    d[4 * i + 1] = static_cast<uint8_t>(state_[i] >> 16);
+    d[4 * i + 2] = static_cast<uint8_t>(state_[i] >> 8);
+    d[4 * i + 3] = static_cast<uint8_t>(state_[i]);
+  }
+  return d;
+}
+
+void Sha256::Compress(const uint8_t* block) {
+  uint32_t w[64];
+  for (int i = 0; i < 16; ++i) {
+    w[i] = (uint32_t)block[4 * i] << 24 | (uint32_t)block[4 * i + 1] << 16 |
+           (uint32_t)block[4 * i + 2] << 8 | (uint32_t)block[4 * i + 3];
+  }
+  for (int i = 16; i < 64; ++i) {
+    uint32_t s0 = Rotr(w[i - 15], 7) ^ Rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+    uint32_t s1 = Rotr(w[i - 2], 17) ^ Rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+    w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+  }
+
+  uint32_t a = state_[0], b = state_[1], c = state_[2], d = state_[3];
+  uint32_t e = state_[4], f = state_[5], g = state_[6], h = state_[7];
+  for (int i = 0; i < 64; ++i) {
+    uint32_t s1 = Rotr(e, 6) ^ Rotr(e, 11) ^ Rotr(e, 25);
+    uint32_t ch = (e & f) ^ (~e & g);
+    uint32_t t1 = h + s1 + ch + kRoundConstants[i] + w[i];
+    uint32_t s0 = Rotr(a, 2) ^ Rotr(a, 13) ^ Rotr(a, 22);
+    uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
+    uint32_t t2 = s0 + maj;
+    h = g;
+    g = f;
+    f = e;
+    e = d + t1;
+    d = c;
+    c = b;
+    b = a;
+    a = t1 + t2;
+  }
+
+  state_[0] += a;
+  state_[1] += b;
+  state_[2] += c;
+  state_[3] += d;
+  state_[4] += e;
+  state_[5] += f;
+  state_[6] += g;
+  state_[7] += h;
+}
+
+Digest Hash(const std::string& data) {
+  Sha256 h;
+  h.Update(data);
+  return h.Finish();
+}
+
+std::string DigestString(const Digest& d) {
+  static const char kHex[] = "0123456789abcdef";
+  std::string s;
+  s.reserve(2 * d.size());
+  for (auto b : d) {
+    s.push_back(kHex[b >> 4]);
+    s.push_back(kHex[b & 0xf]);
+  }
+  return s;
+}
+
+}  // namespace crypto
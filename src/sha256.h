@@ -0,0 +1,47 @@
+#ifndef SHA256_H_
+#define SHA256_H_
+
+#include <array>
+#include <cstdint>
+#include <string>
+
+namespace crypto {
+
+// Digest is the output of the SHA-256 hash function.
+typedef std::array<uint8_t, 32> Digest;
+
+// Computes the SHA-256 digest of data incrementally. A self-contained
+// implementation of FIPS 180-4, so that no external crypto library is needed.
+class Sha256 {
+ public:
+  Sha256();
+
+  // Adds n bytes of data to the digest.
+  void Update(const void* data, size_t n);
+  inline void Update(const std::string& data) {
+    Update(data.data(), data.size());
+  }
+
+  // Returns the digest of all data added so far. The hasher can not be used
+  // anymore afterwards.
+  Digest Finish();
+
+ private:
+  uint32_t state_[8];
+  uint8_t block_[64];
+  size_t block_len_;
+  uint64_t total_len_;
+
+  // Compresses the full block_ into state_.
+  void Compress(const uint8_t* block);
+};
+
+// Computes the SHA-256 digest of data in one call.
+Digest Hash(const std::string& data);
+
+// Returns the hexadecimal representation of the digest.
+std::string DigestString(const Digest& d);
+
+}  // namespace crypto
+
+#endif
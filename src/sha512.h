@@ -0,0 +1,41 @@
+#ifndef SHA512_H_
+#define SHA512_H_
+
+#include <array>
+#include <cstdint>
+#include <string>
+
+namespace crypto {
+
+// Digest512 is the output of the SHA-512 hash function.
+typedef std::array<uint8_t, 64> Digest512;
+
+// Computes the SHA-512 digest of data incrementally, as needed by Ed25519. A
+// self-contained implementation of FIPS 180-4, like Sha256.
+class Sha512 {
+ public:
+  Sha512();
+
+  // Adds n bytes of data to the digest.
+  void Update(const void* data, size_t n);
+  inline void Update(const std::string& data) {
+    Update(data.data(), data.size());
+  }
+
+  // Returns the digest of all data added so far. The hasher can not be used
+  // anymore afterwards.
+  Digest512 Finish();
+
+ private:
+  uint64_t state_[8];
+  uint8_t block_[128];
+  size_t block_len_;
+  uint64_t total_len_;
+
+  // Compresses the full block_ into state_.
+  void Compress(const uint8_t* block);
+};
+
+}  // namespace crypto
+
+#endif
@@ -0,0 +1,190 @@
+#include "signed_messages.h"
+
+#include <stdexcept>
+
+namespace generals {
+
+
+bool ValidPath(const msg::Message& msg, unsigned int round, size_t process_num,
+               unsigned int id) {
+  // Invalid if the message has an incorrect number of ids.
+  if (round + 1 != msg.ids.size()) {
+    return false;
+  }
+  // Invalid if the first message is not from the General (pid 0);
+  if (msg.ids.at(0) != 0) {
+    return false;
+  }
+  // Invalid if not all ids are unique.
+  std::set<unsigned int> idset;
+  for (auto const& pid : msg.ids) {
+    // Invalid if any id is out of bounds.
+    if (pid >= process_num) {
+      return false;
+    }
+    // Invalid if any id is our id.
+    if (pid == id) {
+      return false;
+    }
+    idset.insert(pid);
+  }
+  if (idset.size() < msg.ids.size()) {
+    return false;
+  }
+  return true;
+}
+
+void DropValue(msg::Message& msg) {
+  if (msg.value && !msg.auth.empty()) {
+    auto digest = crypto::Hash(*msg.value);
+    msg.value_digest.assign(digest.begin(), digest.end());
+  }
+  msg.value = {};
+}
+
+SignedMessages::SignedMessages(size_t process_num, unsigned int id,
+                               std::shared_ptr<const RoundPlan> plan,
+                               RelayMode relay_mode, msg::Value default_value)
+    : process_num_(process_num),
+      id_(id),
+      relay_mode_(relay_mode),
+      default_value_(std::move(default_value)),
+      plan_(plan) {
+  if (relay_mode_ == RelayMode::ALL &&
+      (!plan_ || plan_->Processes() != process_num_)) {
+    throw std::invalid_argument("relaying every message needs a round plan");
+  }
+}
+
+bool SignedMessages::ValidMessage(const msg::Message& msg,
+                                  unsigned int round) const {
+  return ValidPath(msg, round, process_num_, id_);
+}
+
+bool SignedMessages::Receive(msg::Message msg, unsigned int round) {
+  if (round == 0) {
+    // Only handle the first real value.
+    if (msg.value && values_seen_.size() == 0) {
+      SeeValue(*msg.value);
+      msgs_this_round_.insert(msg);
+      return true;
+    }
+    return false;
+  }
+
+  // Handle if not a replay of a previous message (msg with same ids).
+  if (ids_this_round_.count(msg.ids) != 0) {
+    return false;
+  }
+  ids_this_round_.insert(msg.ids);
+
+  if (relay_mode_ == RelayMode::ONCE) {
+    // Only forward the first two values we see, and nothing else. The round
+    // completes through done markers instead of message counts.
+    if (msg.value && values_seen_.size() < 2 && SeeValue(*msg.value)) {
+      msgs_this_round_.insert(msg);
+    }
+    return false;
+  }
+
+  // Handle the value in the message based on if we've seen the same value or
+  // not. If we have not seen it yet, SeeValue adds it to the values_seen set
+  // and we forward it in the next round.
+  if (!msg.value || !SeeValue(*msg.value)) {
+    // We have already seen this value, so we forward a no_order instead next
+    // round.
+    DropValue(msg);
+  }
+
+  // Record the message so we can forward it next round.
+  msgs_this_round_.insert(msg);
+
+  // Determine if this is the last message needed for the round.
+  return RoundComplete(round);
+}
+
+bool SignedMessages::ReceiveDone(unsigned int pid, unsigned int round) {
+  // The Commander only ever sends in the first round, which completes on its
+  // message alone.
+  if (relay_mode_ != RelayMode::ONCE || round == 0 || pid == 0) {
+    return false;
+  }
+  if (!done_this_round_.insert(pid).second) {
+    return false;
+  }
+  return RoundComplete(round);
+}
+
+bool SignedMessages::RoundComplete(unsigned int round) const {
+  if (round == 0) {
+    return !msgs_this_round_.empty();
+  }
+  if (relay_mode_ == RelayMode::ONCE) {
+    // Every Lieutenant but ourselves must be done.
+    return done_this_round_.size() == process_num_ - 2;
+  }
+  return round <= plan_->LastRound() &&
+         ids_this_round_.size() == plan_->Messages(round);
+}
+
+Outbox SignedMessages::NextRound(unsigned int round) {
+  // Determine the set of messages to forward in the next round.
+  Outbox toSend;
+  if (relay_mode_ == RelayMode::ONCE) {
+    for (unsigned int pid = 1; pid < process_num_; ++pid) {
+      if (pid != id_) toSend[pid];
+    }
+  }
+  for (msg::Message msg : msgs_this_round_) {
+    if (msg.round != round - 1) {
+      throw std::logic_error(
+          "message in msgs_this_round_ not from current round");
+    }
+
+    // Update the messages round number to the current round.
+    msg.round = round;
+
+    // Add this process in at the end of the message id list.
+    msg.ids.push_back(id_);
+
+    // Determine which processes we need to send this message to.
+    for (unsigned int pid = 0; pid < process_num_; ++pid) {
+      // Only send to processes not already in this message.
+      bool inMsg = false;
+      for (auto const& id : msg.ids) {
+        if (id == pid) {
+          inMsg = true;
+          break;
+        }
+      }
+      if (!inMsg) {
+        toSend[pid].push_back(msg);
+      }
+    }
+  }
+
+  // Clear round-specific containers.
+  ids_this_round_.clear();
+  msgs_this_round_.clear();
+  done_this_round_.clear();
+  return toSend;
+}
+
+msg::Value SignedMessages::Decide() const {
+  if (values_seen_.size() == 1) {
+    return first_value_;
+  }
+  return default_value_;
+}
+
+bool SignedMessages::SeeValue(const msg::Value& v) {
+  if (!values_seen_.insert(crypto::Hash(v)).second) {
+    return false;
+  }
+  if (values_seen_.size() == 1) {
+    first_value_ = v;
+  }
+  return true;
+}
+
+}  // namespace generals
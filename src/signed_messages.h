@@ -0,0 +1,101 @@
+#ifndef SIGNED_MESSAGES_H_
+#define SIGNED_MESSAGES_H_
+
+#include <memory>
+#include <set>
+#include <vector>
+
+#include "message.h"
+#include "protocol.h"
+#include "round_plan.h"
+#include "sha256.h"
+
+namespace generals {
+
+// Validates that the path of process IDs in the message makes sense for a
+// message received during the provided round by process id in a system of
+// process_num processes. This does not check the sender of the message.
+bool ValidPath(const msg::Message& msg, unsigned int round, size_t process_num,
+               unsigned int id);
+
+// Removes the value of a message that is relayed without it. An authenticated
+// message keeps the digest of the value instead, since the authenticators of
+// the hops that relayed the value cover it (see MessageAuth).
+void DropValue(msg::Message& msg);
+
+// Holds the state of a single instance of the Byzantine Agreement Algorithm
+// with signed messages from the point of view of a Lieutenant. In round r, a
+// Lieutenant receives messages whose path holds r + 1 ids, and relays them to
+// the processes not yet in their path in round r + 1.
+//
+// Values are tracked by digest, so that large values are only ever stored once
+// and never compared byte by byte.
+class SignedMessages : public Protocol {
+ public:
+  // Creates the state of process id among process_num processes. When relaying
+  // every message, rounds complete according to the provided plan, which is
+  // shared by all instances (see ProtocolSpec::Plan). It is not needed when
+  // relaying once.
+  SignedMessages(size_t process_num, unsigned int id,
+                 std::shared_ptr<const RoundPlan> plan,
+                 RelayMode relay_mode = RelayMode::ALL,
+                 msg::Value default_value =
+                     msg::OrderValue(msg::Order::RETREAT));
+
+  // Validates the path of the message (see ValidPath).
+  bool ValidMessage(const msg::Message& msg, unsigned int round) const;
+
+  bool Receive(msg::Message msg, unsigned int round);
+
+  // Markers only matter when relaying once.
+  bool ReceiveDone(unsigned int pid, unsigned int round);
+
+  // Decides if the provided round is complete based on the number of messages
+  // received, as given by the plan, or the number of done markers when relaying
+  // once.
+  bool RoundComplete(unsigned int round) const;
+
+  // Returns the messages received last round that need to be forwarded to
+  // other processes in this one. When relaying once, every other Lieutenant is
+  // present in the result, because it still needs to be marked done.
+  Outbox NextRound(unsigned int round);
+
+  // Decides what the value should be based on the seen values over the course
+  // of the agreement algorithm. Defined as follows:
+  //
+  // choice(V) := v        if V = {v}
+  //            | default  if V = {} or |V| >= 2
+  //
+  // where the default value is RETREAT unless specified otherwise.
+  msg::Value Decide() const;
+
+ private:
+  const size_t process_num_;
+  const unsigned int id_;
+  const RelayMode relay_mode_;
+  const msg::Value default_value_;
+  std::shared_ptr<const RoundPlan> plan_;
+
+  // The set of digests of the unique values seen over the course of the
+  // agreement algorithm.
+  std::set<crypto::Digest> values_seen_;
+  // The first value seen, which is the decision if it is the only one.
+  msg::Value first_value_;
+
+  // Records the value as seen. Returns whether it had not been seen before.
+  bool SeeValue(const msg::Value& v);
+
+  // Per-round variables:
+
+  // Contains the set of all unique messages received so far this round.
+  std::set<msg::Message> msgs_this_round_;
+  // Same as msgs_this_round_, except with only the ids so that all messages
+  // with the same process list collide.
+  std::set<std::vector<unsigned int>> ids_this_round_;
+  // The Lieutenants that have marked themselves done with this round.
+  std::set<unsigned int> done_this_round_;
+};
+
+}  // namespace generals
+
+#endif
@@ -0,0 +1,78 @@
+#include "siphash.h"
+
+namespace crypto {
+
+namespace {
+
+inline uint64_t Rotl(uint64_t x, unsigned int b) {
+  return (x << b) | (x >> (64 - b));
+}
+
+// Reads a little-endian uint64_t from the buffer.
+inline uint64_t ReadU64LE(const uint8_t* p) {
+  uint64_t v = 0;
+  for (int i = 7; i >= 0; --i) {
+    v = (v << 8) | p[i];
+  }
+  return v;
+}
+
+// A single SipRound on the state.
+inline void SipRound(uint64_t& v0, uint64_t& v1, uint64_t& v2, uint64_t& v3) {
+  v0 += v1;
+  v1 = Rotl(v1, 13);
+  v1 ^= v0;
+  v0 = Rotl(v0, 32);
+  v2 += v3;
+  v3 = Rotl(v3, 16);
+  v3 ^= v2;
+  v0 += v3;
+  v3 = Rotl(v3, 21);
+  v3 ^= v0;
+  v2 += v1;
+  v1 = Rotl(v1, 17);
+  v1 ^= v2;
+  v2 = Rotl(v2, 32);
+}
+
+}  // namespace
+
+uint64_t SipHash24(const SipKey& key, const void* data, size_t n) {
+  const uint8_t* in = static_cast<const uint8_t*>(data);
+  uint64_t k0 = ReadU64LE(key.data());
+  uint64_t k1 = ReadU64LE(key.data() + 8);
+  uint64_t v0 = k0 ^ 0x736f6d6570736575ULL;
+  uint64_t v1 = k1 ^ 0x646f72616e646f6dULL;
+  uint64_t v2 = k0 ^ 0x6c7967656e657261ULL;
+  uint64_t v3 = k1 ^ 0x7465646279746573ULL;
+
+  // Compress every full 8 byte word of the input.
+  const uint8_t* end = in + (n - n % 8);
+  for (; in != end; in += 8) {
+    uint64_t m = ReadU64LE(in);
+    v3 ^= m;
+    SipRound(v0, v1, v2, v3);
+    SipRound(v0, v1, v2, v3);
+    v0 ^= m;
+  }
+
+  // The last word holds the remaining bytes and the length of the input.
+  uint64_t b = static_cast<uint64_t>(n) << 56;
+  for (size_t i = 0; i < n % 8; ++i) {
+    b |= static_cast<uint64_t>(in[i]) << (8 * i);
+  }
+  v3 ^= b;
+  SipRound(v0, v1, v2, v3);
+  SipRound(v0, v1, v2, v3);
+  v0 ^= b;
+
+  // Finalize.
+  v2 ^= 0xff;
+  SipRound(v0, v1, v2, v3);
+  SipRound(v0, v1, v2, v3);
+  SipRound(v0, v1, v2, v3);
+  SipRound(v0, v1, v2, v3);
+  return v0 ^ v1 ^ v2 ^ v3;
+}
+
+}  // namespace crypto
@@ -0,0 +1,21 @@
+#ifndef SIPHASH_H_
+#define SIPHASH_H_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace crypto {
+
+// SipKey is a secret key for SipHash.
+typedef std::array<uint8_t, 16> SipKey;
+
+// Computes the SipHash-2-4 MAC of n bytes of data. SipHash is a fast keyed hash
+// for short inputs, well suited to authenticating every datagram. A
+// self-contained implementation of the reference algorithm by Aumasson and
+// Bernstein.
+uint64_t SipHash24(const SipKey& key, const void* data, size_t n);
+
+}  // namespace crypto
+
+#endif
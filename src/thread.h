@@ -1,6 +1,11 @@
 #ifndef THREAD_H_
 #define THREAD_H_
 
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
 #include <thread>
 #include <utility>
 #include <vector>
@@ -31,6 +36,97 @@ class ThreadGroup {
   std::vector<std::thread> threads_;
 };
 
+// A fixed group of worker threads that run the iterations of parallel loops,
+// so that short loops do not pay for starting threads.
+class WorkerPool {
+ public:
+  explicit WorkerPool(unsigned int threads) {
+    for (unsigned int i = 0; i < threads; ++i) {
+      workers_.push_back(std::thread([this] { Work(); }));
+    }
+  }
+
+  ~WorkerPool() {
+    {
+      std::lock_guard<std::mutex> lock(mu_);
+      stop_ = true;
+    }
+    wake_.notify_all();
+    for (auto& worker : workers_) {
+      worker.join();
+    }
+  }
+
+  // Returns the number of worker threads.
+  inline size_t Size() const { return workers_.size(); }
+
+  // Runs f(i) for every i in [0, n) on the workers and the calling thread, and
+  // returns once all of them have run. Iterations are handed out in chunks, so
+  // f should be cheap to call. Only one loop may run at a time.
+  void ParallelFor(size_t n, const std::function<void(size_t)>& f) {
+    std::unique_lock<std::mutex> lock(mu_);
+    fn_ = &f;
+    next_ = 0;
+    end_ = n;
+    chunk_ = std::max<size_t>(1, n / (4 * (workers_.size() + 1)));
+    generation_++;
+    wake_.notify_all();
+
+    RunLoop(lock);
+    done_.wait(lock, [this] { return next_ >= end_ && running_ == 0; });
+    fn_ = nullptr;
+  }
+
+ private:
+  std::vector<std::thread> workers_;
+  std::mutex mu_;
+  std::condition_variable wake_;
+  std::condition_variable done_;
+  bool stop_ = false;
+  // The loop currently running, if any, and its next and last iterations.
+  const std::function<void(size_t)>* fn_ = nullptr;
+  size_t next_ = 0;
+  size_t end_ = 0;
+  size_t chunk_ = 1;
+  // The number of threads running a chunk of the loop.
+  unsigned int running_ = 0;
+  // Incremented for every loop, so that workers notice new ones.
+  uint64_t generation_ = 0;
+
+  // Waits for loops and runs them until the pool is destroyed.
+  void Work() {
+    std::unique_lock<std::mutex> lock(mu_);
+    uint64_t seen = 0;
+    while (true) {
+      wake_.wait(lock, [&] { return stop_ || generation_ != seen; });
+      if (stop_) return;
+      seen = generation_;
+      RunLoop(lock);
+    }
+  }
+
+  // Claims and runs chunks of the current loop until none are left. The lock
+  // is held while claiming, but not while running.
+  void RunLoop(std::unique_lock<std::mutex>& lock) {
+    while (fn_ != nullptr && next_ < end_) {
+      size_t begin = next_;
+      size_t end = std::min(end_, begin + chunk_);
+      next_ = end;
+      running_++;
+      auto f = fn_;
+      lock.unlock();
+      for (size_t i = begin; i < end; ++i) {
+        (*f)(i);
+      }
+      lock.lock();
+      running_--;
+    }
+    if (next_ >= end_ && running_ == 0) {
+      done_.notify_all();
+    }
+  }
+};
+
 }  // namespace threadutil
 
 #endif
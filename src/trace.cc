@@ -0,0 +1,95 @@
+#include "trace.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+
+namespace tracing {
+
+static_assert(sizeof(TraceHeader) == 64, "trace header must be 64 bytes");
+static_assert(sizeof(Event) == 32, "trace events must be 32 bytes");
+
+// Needed to be defined in .cc file to avoid duplicate symbols.
+Tracer trace;
+
+namespace {
+
+// Returns the steady clock in nanoseconds.
+uint64_t NowNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+}  // namespace
+
+Tracer::Tracer()
+    : map_(nullptr), map_size_(0), events_(nullptr), mask_(0), next_(0) {}
+
+Tracer::~Tracer() {
+  if (map_) {
+    events_ = nullptr;
+    munmap(map_, map_size_);
+  }
+}
+
+void Tracer::Open(const std::string& path, size_t capacity, unsigned int id) {
+  if (map_) {
+    throw std::logic_error("trace file already open");
+  }
+  size_t slots = 1;
+  while (slots < capacity) slots <<= 1;
+  size_t size = sizeof(TraceHeader) + slots * sizeof(Event);
+
+  int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    throw std::runtime_error("could not open trace file " + path);
+  }
+  // The file is truncated first, so that every slot reads as never written.
+  if (ftruncate(fd, size) != 0) {
+    close(fd);
+    throw std::runtime_error("could not size trace file " + path);
+  }
+  void* map = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    throw std::runtime_error("could not map trace file " + path);
+  }
+
+  auto header = static_cast<TraceHeader*>(map);
+  std::memcpy(header->magic, kTraceMagic, sizeof(header->magic));
+  header->version = kTraceVersion;
+  header->event_size = sizeof(Event);
+  header->capacity = slots;
+  header->id = id;
+  header->start_ns = NowNs();
+
+  map_ = map;
+  map_size_ = size;
+  mask_ = slots - 1;
+  next_ = 0;
+  events_ = reinterpret_cast<Event*>(header + 1);
+}
+
+void Tracer::Append(EventType type, uint16_t peer, uint32_t round,
+                    uint32_t value, uint32_t extra) {
+  uint64_t index = next_.fetch_add(1, std::memory_order_relaxed);
+  Event& e = events_[index & mask_];
+  // Invalidate the slot while it is rewritten, so that a reader of a file left
+  // by a crash in between skips it rather than mixing two events.
+  __atomic_store_n(&e.seq, 0, __ATOMIC_RELAXED);
+  e.ns = NowNs();
+  e.round = round;
+  e.value = value;
+  e.type = static_cast<uint16_t>(type);
+  e.peer = peer;
+  e.extra = extra;
+  __atomic_store_n(&e.seq, index + 1, __ATOMIC_RELEASE);
+}
+
+}  // namespace tracing
@@ -0,0 +1,124 @@
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+namespace tracing {
+
+// The number of events a trace file holds by default before the oldest are
+// overwritten.
+const size_t kDefaultTraceEvents = 1 << 16;
+
+// Identifies trace files, and the version of their format.
+const char kTraceMagic[8] = {'G', 'T', 'R', 'A', 'C', 'E', '\0', '\0'};
+const uint32_t kTraceVersion = 1;
+
+// The peer of events that have none, or whose peer is not known.
+const uint16_t kNoPeer = 0xffff;
+
+// The kinds of events traced.
+enum class EventType : uint16_t {
+  // The first attempt to send a datagram to the peer. value is the sequence
+  // number of the datagram (see generals::AckId).
+  SEND = 1,
+  // A later attempt to send a datagram to the peer. extra is the attempt.
+  RETRANSMIT = 2,
+  // The acknowledgement of a datagram sent to the peer. extra is the time from
+  // its first attempt in microseconds, which is only a round trip if it was
+  // never retransmitted.
+  ACK = 3,
+  // A datagram to the peer that was never acknowledged after every attempt.
+  GIVE_UP = 4,
+  // A valid message or marker from the peer. value is its sequence number.
+  RECEIVE = 5,
+  // A datagram rejected as invalid, from the peer if it is known. extra is the
+  // generals::Rejection.
+  REJECT = 6,
+  // The start of the round.
+  ROUND_START = 7,
+  // The end of the round. extra is 1 if the round was complete, and 0 if it
+  // timed out.
+  ROUND_END = 8,
+  // The decision, in the last round.
+  DECIDE = 9,
+};
+
+// The header at the start of a trace file, in the byte order of the host that
+// wrote it.
+struct TraceHeader {
+  char magic[8];
+  uint32_t version;
+  // The size of each Event, so that readers can tell a mismatched format.
+  uint32_t event_size;
+  // The number of event slots following the header, a power of two.
+  uint64_t capacity;
+  // The process that wrote the trace.
+  uint32_t id;
+  uint32_t reserved;
+  // The steady clock when the trace was opened, in nanoseconds. The steady
+  // clock is shared by all processes on a host, so their traces line up.
+  uint64_t start_ns;
+  uint8_t padding[24];
+};
+
+// A single event, in the slot of its index modulo the capacity of the file.
+struct Event {
+  // The index of the event plus one, written last, so that slots that were
+  // never written or were torn by a crash can be told apart.
+  uint64_t seq;
+  // The steady clock when the event happened, in nanoseconds.
+  uint64_t ns;
+  uint32_t round;
+  uint32_t value;
+  uint16_t type;
+  uint16_t peer;
+  uint32_t extra;
+};
+
+// Records events into a memory-mapped ring file, so that they survive the
+// process without any writes on its part, at the cost of a clock read and an
+// atomic increment per event. Once the ring is full, the oldest events are
+// overwritten. Recording is off until a file is opened, and is safe from any
+// thread.
+class Tracer {
+ public:
+  Tracer();
+  // Unmaps the file, leaving it to be analyzed (see
+  // generals::AnalyzeTrace).
+  ~Tracer();
+
+  // Creates, or replaces, the trace file at the provided path, holding the
+  // latest capacity events of process id, rounded up to a power of two, and
+  // starts recording into it. Must be called before any other thread records.
+  // Throws an exception if the file can not be mapped.
+  void Open(const std::string& path, size_t capacity, unsigned int id);
+
+  // Determines if events are recorded.
+  inline bool Enabled() const { return events_ != nullptr; }
+
+  // Records an event, if events are recorded.
+  inline void Record(EventType type, uint16_t peer, uint32_t round,
+                     uint32_t value = 0, uint32_t extra = 0) {
+    if (events_) Append(type, peer, round, value, extra);
+  }
+
+ private:
+  void* map_;
+  size_t map_size_;
+  Event* events_;
+  uint64_t mask_;
+  std::atomic<uint64_t> next_;
+
+  void Append(EventType type, uint16_t peer, uint32_t round, uint32_t value,
+              uint32_t extra);
+};
+
+// The tracer of the process. This should always be used instead of creating new
+// Tracer instances.
+extern Tracer trace;
+
+}  // namespace tracing
+
+#endif
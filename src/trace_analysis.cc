@@ -0,0 +1,192 @@
+#include "trace_analysis.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <set>
+#include <stdexcept>
+#include <tuple>
+
+#include "trace.h"
+
+namespace generals {
+
+std::ostream& operator<<(std::ostream& o, const TraceCounts& c) {
+  return o << "{sent: " << c.sent << ", retransmits: " << c.retransmits
+           << ", acks: " << c.acks << ", give_ups: " << c.give_ups
+           << ", received: " << c.received << ", rejected: " << c.rejected
+           << "}";
+}
+
+std::ostream& operator<<(std::ostream& o, const TraceRound& r) {
+  o << "Round " << r.round << ": ";
+  if (r.started) {
+    o << "started at " << r.start.count() << "us";
+  } else {
+    o << "start not traced";
+  }
+  if (r.ended) {
+    o << ", ended at " << r.end.count() << "us";
+    if (r.started) o << " after " << (r.end - r.start).count() << "us";
+    o << (r.complete ? " complete" : " timed out");
+  }
+  if (r.counts.received > 0) {
+    o << ", received from " << r.first_receive.count() << "us to "
+      << r.last_receive.count() << "us";
+  }
+  return o << ", " << r.counts;
+}
+
+std::ostream& operator<<(std::ostream& o, const TracePeer& p) {
+  if (p.id == tracing::kNoPeer) {
+    o << "Unknown peer: ";
+  } else {
+    o << "Peer p" << p.id << ": ";
+  }
+  return o << p.counts << ", ack_rtt: " << p.ack_rtt;
+}
+
+std::ostream& operator<<(std::ostream& o, const TraceAnalysis& a) {
+  o << "Trace of p" << a.id << ": " << a.events << " events";
+  if (a.overwritten > 0) {
+    o << ", " << a.overwritten << " older ones overwritten";
+  }
+  if (a.decided) {
+    o << ", decided at " << a.decision.count() << "us";
+  }
+  o << "\n";
+  for (auto const& r : a.rounds) o << r << "\n";
+  for (auto const& p : a.peers) o << p << "\n";
+  return o;
+}
+
+namespace {
+
+// Reads the header and every written event of the trace file, in the order
+// they were recorded.
+std::vector<tracing::Event> ReadTrace(const std::string& path,
+                                      tracing::TraceHeader& header) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file) {
+    throw std::runtime_error("could not open trace file " + path);
+  }
+  if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+      std::memcmp(header.magic, tracing::kTraceMagic, sizeof(header.magic)) !=
+          0) {
+    throw std::runtime_error(path + " is not a trace file");
+  }
+  if (header.version != tracing::kTraceVersion ||
+      header.event_size != sizeof(tracing::Event)) {
+    throw std::runtime_error("unsupported trace file version");
+  }
+
+  // Slots that were never written, or were being rewritten when the process
+  // stopped, have no sequence number.
+  std::vector<tracing::Event> events;
+  tracing::Event e;
+  for (uint64_t i = 0; i < header.capacity; ++i) {
+    if (!file.read(reinterpret_cast<char*>(&e), sizeof(e))) {
+      throw std::runtime_error("truncated trace file");
+    }
+    if (e.seq != 0) events.push_back(e);
+  }
+  std::sort(events.begin(), events.end(),
+            [](const tracing::Event& a, const tracing::Event& b) {
+              return a.seq < b.seq;
+            });
+  return events;
+}
+
+}  // namespace
+
+TraceAnalysis AnalyzeTrace(const std::string& path) {
+  tracing::TraceHeader header;
+  auto events = ReadTrace(path, header);
+
+  TraceAnalysis analysis;
+  analysis.id = header.id;
+  analysis.events = events.size();
+  if (!events.empty()) {
+    analysis.overwritten = events.back().seq - events.size();
+  }
+
+  std::map<unsigned int, TraceRound> rounds;
+  std::map<unsigned int, TracePeer> peers;
+  std::map<unsigned int, LatencyHistogram> rtts;
+  // The datagrams that were retransmitted, whose acknowledgements are not
+  // round trips.
+  std::set<std::tuple<unsigned int, unsigned int, uint32_t>> retransmitted;
+  for (auto const& e : events) {
+    auto at = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::nanoseconds(e.ns - header.start_ns));
+    auto type = static_cast<tracing::EventType>(e.type);
+    if (type == tracing::EventType::DECIDE) {
+      analysis.decided = true;
+      analysis.decision = at;
+      continue;
+    }
+
+    auto& round = rounds[e.round];
+    round.round = e.round;
+    TraceCounts* peer = nullptr;
+    if (type != tracing::EventType::ROUND_START &&
+        type != tracing::EventType::ROUND_END) {
+      peers[e.peer].id = e.peer;
+      peer = &peers[e.peer].counts;
+    }
+    switch (type) {
+      case tracing::EventType::SEND:
+        round.counts.sent++;
+        peer->sent++;
+        break;
+      case tracing::EventType::RETRANSMIT:
+        round.counts.retransmits++;
+        peer->retransmits++;
+        retransmitted.emplace(e.peer, e.round, e.value);
+        break;
+      case tracing::EventType::ACK:
+        round.counts.acks++;
+        peer->acks++;
+        if (!retransmitted.count(std::make_tuple(e.peer, e.round, e.value))) {
+          rtts[e.peer].Record(std::chrono::microseconds{e.extra});
+        }
+        break;
+      case tracing::EventType::GIVE_UP:
+        round.counts.give_ups++;
+        peer->give_ups++;
+        break;
+      case tracing::EventType::RECEIVE:
+        if (round.counts.received == 0) round.first_receive = at;
+        round.last_receive = at;
+        round.counts.received++;
+        peer->received++;
+        break;
+      case tracing::EventType::REJECT:
+        round.counts.rejected++;
+        peer->rejected++;
+        break;
+      case tracing::EventType::ROUND_START:
+        round.started = true;
+        round.start = at;
+        break;
+      case tracing::EventType::ROUND_END:
+        round.ended = true;
+        round.end = at;
+        round.complete = e.extra != 0;
+        break;
+      default:
+        throw std::runtime_error("unknown trace event type");
+    }
+  }
+
+  for (auto const& r : rounds) analysis.rounds.push_back(r.second);
+  for (auto& p : peers) {
+    auto rtt = rtts.find(p.first);
+    if (rtt != rtts.end()) p.second.ack_rtt = rtt->second.Summarize();
+    analysis.peers.push_back(p.second);
+  }
+  return analysis;
+}
+
+}  // namespace generals
@@ -0,0 +1,85 @@
+#ifndef TRACE_ANALYSIS_H_
+#define TRACE_ANALYSIS_H_
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "histogram.h"
+
+namespace generals {
+
+// The datagrams a process exchanged, in a round or with a peer, according to
+// its trace.
+struct TraceCounts {
+  uint64_t sent = 0;
+  uint64_t retransmits = 0;
+  uint64_t acks = 0;
+  uint64_t give_ups = 0;
+  uint64_t received = 0;
+  uint64_t rejected = 0;
+};
+
+// Allow streaming of TraceCounts on ostreams.
+std::ostream& operator<<(std::ostream& o, const TraceCounts& c);
+
+// The timeline of a round in a trace. Times are since the trace was opened.
+// The start or the end of a round may be missing if the events of the round
+// were overwritten, or if the process is the Commander, which has no rounds.
+struct TraceRound {
+  unsigned int round;
+  bool started = false;
+  std::chrono::microseconds start{0};
+  bool ended = false;
+  std::chrono::microseconds end{0};
+  // Whether the round ended with every message it expected.
+  bool complete = false;
+  TraceCounts counts;
+  // When the first and the last datagram of the round were received, if any.
+  std::chrono::microseconds first_receive{0};
+  std::chrono::microseconds last_receive{0};
+};
+
+// Allow streaming of TraceRound on ostreams.
+std::ostream& operator<<(std::ostream& o, const TraceRound& r);
+
+// The datagrams exchanged with a single peer in a trace, and the round trips of
+// their acknowledgements.
+struct TracePeer {
+  // The peer, or tracing::kNoPeer for rejected datagrams from an unknown one.
+  unsigned int id;
+  TraceCounts counts;
+  LatencySummary ack_rtt;
+};
+
+// Allow streaming of TracePeer on ostreams.
+std::ostream& operator<<(std::ostream& o, const TracePeer& p);
+
+// What a trace file holds about the process that wrote it.
+struct TraceAnalysis {
+  unsigned int id;
+  // The events still in the file, and the older ones overwritten by them.
+  uint64_t events = 0;
+  uint64_t overwritten = 0;
+  // When the process decided, if the decision is still in the file.
+  bool decided = false;
+  std::chrono::microseconds decision{0};
+  // Ordered by round and by peer.
+  std::vector<TraceRound> rounds;
+  std::vector<TracePeer> peers;
+};
+
+// Allow streaming of TraceAnalysis on ostreams, as a report with a line per
+// round and per peer.
+std::ostream& operator<<(std::ostream& o, const TraceAnalysis& a);
+
+// Decodes the trace file at the provided path (see tracing::Tracer), which may
+// have been left by a process that crashed or is still running. Throws
+// std::runtime_error if the file can not be read or is not a trace.
+TraceAnalysis AnalyzeTrace(const std::string& path);
+
+}  // namespace generals
+
+#endif
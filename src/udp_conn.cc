@@ -1,5 +1,12 @@
 #include "udp_conn.h"
 
+#include <poll.h>
+#include <sys/timerfd.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <algorithm>
+
 namespace udp {
 
 // Creates a UDP socket or throws an exception on error.
@@ -19,21 +26,25 @@ Socket CreateSocket(const std::chrono::microseconds timeout) {
 
   // Set socket timeout if provided.
   if (timeout.count() > 0) {
-    // Truncate to integer number of seconds.
-    const auto secs = std::chrono::duration_cast<std::chrono::seconds>(timeout);
-
-    struct timeval timeval;
-    timeval.tv_sec = secs.count();
-    timeval.tv_usec = (timeout - secs).count();
-    if (setsockopt(sockfd, SOL_SOCKET, SO_RCVTIMEO, (char *)&timeval,
-                   sizeof(timeval))) {
-      throw net::SocketException();
-    }
+    SetSocketTimeout(sockfd, timeout);
   }
 
   return sockfd;
 }
 
+void SetSocketTimeout(Socket sockfd, const std::chrono::microseconds timeout) {
+  // Truncate to integer number of seconds.
+  const auto secs = std::chrono::duration_cast<std::chrono::seconds>(timeout);
+
+  struct timeval timeval;
+  timeval.tv_sec = secs.count();
+  timeval.tv_usec = (timeout - secs).count();
+  if (setsockopt(sockfd, SOL_SOCKET, SO_RCVTIMEO, (char *)&timeval,
+                 sizeof(timeval))) {
+    throw net::SocketException();
+  }
+}
+
 inline bool IsErrnoTimeout() {
   return errno == EAGAIN || errno == EWOULDBLOCK || errno == ECONNREFUSED;
 }
@@ -71,12 +82,46 @@ unsigned short SocketAddress::Port() const { return ntohs(addr_.sin_port); }
 void Client::Send(const char *buf, size_t size) const {
   auto addr = remote_address_.addr();
   auto addrlen = remote_address_.addr_len();
-  if (sendto(sockfd_, buf, size, 0, addr, addrlen) < 0) {
+  if (!link_auth_ || !peer_) {
+    if (sendto(sockfd_, buf, size, 0, addr, addrlen) < 0) {
+      throw net::SendException();
+    }
+    counts_.datagrams_sent++;
+    counts_.bytes_sent += size;
+    return;
+  }
+
+  // Gather the datagram and its trailer, so the datagram is not copied.
+  auto trailer = link_auth_->Trailer(buf, size, *peer_);
+  struct iovec iov[2];
+  iov[0].iov_base = const_cast<char *>(buf);
+  iov[0].iov_len = size;
+  iov[1].iov_base = trailer.data();
+  iov[1].iov_len = trailer.size();
+
+  struct msghdr msg = {};
+  msg.msg_name = const_cast<struct sockaddr *>(addr);
+  msg.msg_namelen = addrlen;
+  msg.msg_iov = iov;
+  msg.msg_iovlen = 2;
+  if (sendmsg(sockfd_, &msg, 0) < 0) {
     throw net::SendException();
   }
+  counts_.datagrams_sent++;
+  counts_.bytes_sent += size + trailer.size();
+}
+
+ClientCounts Client::Counts() const {
+  ClientCounts c;
+  c.datagrams_sent = counts_.datagrams_sent;
+  c.bytes_sent = counts_.bytes_sent;
+  c.replies_received = counts_.replies_received;
+  c.reply_bytes_received = counts_.reply_bytes_received;
+  c.ack_timeouts = counts_.ack_timeouts;
+  return c;
 }
 
-void Client::SendWithAck(const char *buf, size_t size, unsigned int attempts,
+bool Client::SendWithAck(const char *buf, size_t size, unsigned int attempts,
                          OnReceiveFn validAck) const {
   bool noLimit = attempts == 0;
   for (; noLimit || attempts > 0; --attempts) {
@@ -98,22 +143,42 @@ void Client::SendWithAck(const char *buf, size_t size, unsigned int attempts,
     // anything else, throw an exception.
     if (n < 0) {
       if (IsErrnoTimeout()) {
+        counts_.ack_timeouts++;
         continue;
       } else {
         throw net::ReceiveException();
       }
     }
+    counts_.replies_received++;
+    counts_.reply_bytes_received += n;
+
+    // Drop acks that were not sent by the remote process.
+    size_t size = n;
+    if (link_auth_ && peer_) {
+      auto sender = link_auth_->Open(ackbuf, size);
+      if (!sender || *sender != *peer_) {
+        continue;
+      }
+    }
 
     // Make sure the ack was valid.
-    auto action = validAck(shared_from_this(), ackbuf, n);
+    auto action = validAck(shared_from_this(), ackbuf, size);
     if (action == ServerAction::Stop) {
-      return;
+      return true;
     }
   }
+  return false;
 }
 
-Server::Server(unsigned short port, std::chrono::microseconds timeout)
-    : sockfd_(CreateSocket(timeout)) {
+Server::Server(unsigned short port, LinkAuthPtr link_auth)
+    : sockfd_(CreateSocket(kNoTimeout)),
+      timerfd_(timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)),
+      link_auth_(link_auth),
+      counts_{} {
+  if (timerfd_ < 0) {
+    throw net::TimerException();
+  }
+
   // Create a socket and associate the it with the port
   struct sockaddr_in server_address = {};
   server_address.sin_family = AF_INET;
@@ -126,40 +191,107 @@ Server::Server(unsigned short port, std::chrono::microseconds timeout)
   }
 };
 
+void Server::SetDeadline(std::chrono::steady_clock::time_point deadline) const {
+  // An all-zero expiration disarms the timer instead, so deadlines that
+  // already passed are armed 1ns after the epoch of the clock.
+  const auto since_epoch = std::max(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          deadline.time_since_epoch()),
+      std::chrono::nanoseconds{1});
+  const auto secs =
+      std::chrono::duration_cast<std::chrono::seconds>(since_epoch);
+
+  struct itimerspec spec = {};
+  spec.it_value.tv_sec = secs.count();
+  spec.it_value.tv_nsec = (since_epoch - secs).count();
+  if (timerfd_settime(timerfd_, TFD_TIMER_ABSTIME, &spec, nullptr) < 0) {
+    throw net::TimerException();
+  }
+}
+
+ServerCounts Server::Counts() const {
+  ServerCounts c;
+  c.datagrams_received = counts_.datagrams_received;
+  c.bytes_received = counts_.bytes_received;
+  c.inauthentic = counts_.inauthentic;
+  return c;
+}
+
 void Server::Listen(OnReceiveFn rcv, OnTimeout timeout) const {
+  struct pollfd fds[2] = {};
+  fds[0].fd = timerfd_;
+  fds[0].events = POLLIN;
+  fds[1].fd = sockfd_;
+  fds[1].events = POLLIN;
+
   // While the server is running, wait for datagrams and
   // call the provided closure with their data.
   while (1) {
+    if (poll(fds, 2, -1) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw net::ReceiveException();
+    }
+
+    // Handle the deadline first, so that a steady stream of datagrams can not
+    // hold it back.
+    if (fds[0].revents & POLLIN) {
+      // The timer may have been rearmed since it fired, in which case there
+      // is nothing to read and the deadline did not pass yet.
+      uint64_t expirations;
+      if (read(timerfd_, &expirations, sizeof(expirations)) < 0) {
+        if (errno == EAGAIN) {
+          continue;
+        }
+        throw net::TimerException();
+      }
+      auto action = timeout();
+      switch (action) {
+        case ServerAction::Continue:
+          continue;
+        case ServerAction::Stop:
+          return;
+        default:
+          throw std::invalid_argument("unexpected ServerAction value");
+      }
+    }
+    if (!(fds[1].revents & POLLIN)) {
+      continue;
+    }
+
     // Create a zeroed out buffer to read the message into.
     char buf[BUFSIZE];
     bzero(buf, BUFSIZE);
 
-    // Receive from the socket.
+    // Receive from the socket, which has a datagram waiting.
     struct sockaddr_in clientaddr;
     socklen_t clientlen = sizeof(clientaddr);
-    int n = recvfrom(sockfd_, buf, BUFSIZE, 0, (struct sockaddr *)&clientaddr,
-                     &clientlen);
+    int n = recvfrom(sockfd_, buf, BUFSIZE, MSG_DONTWAIT,
+                     (struct sockaddr *)&clientaddr, &clientlen);
     if (n < 0) {
       if (IsErrnoTimeout()) {
-        auto action = timeout();
-        switch (action) {
-          case ServerAction::Continue:
-            continue;
-          case ServerAction::Stop:
-            return;
-          default:
-            throw std::invalid_argument("unexpected ServerAction value");
-        }
-      } else {
-        throw net::ReceiveException();
+        continue;
       }
+      throw net::ReceiveException();
     }
+    counts_.datagrams_received++;
+    counts_.bytes_received += n;
 
-    // Call closure with new client.
-    auto client = std::make_shared<udp::Client>(clientaddr);
+    // Call closure with new client. With link authentication, the client
+    // identifies the sender of the datagram and signs its replies.
+    size_t size = n;
+    std::shared_ptr<udp::Client> client;
+    if (link_auth_) {
+      auto sender = link_auth_->Open(buf, size);
+      if (!sender) counts_.inauthentic++;
+      client = std::make_shared<udp::Client>(clientaddr, link_auth_, sender);
+    } else {
+      client = std::make_shared<udp::Client>(clientaddr);
+    }
 
     // Call the receive callback with the data received.
-    auto action = rcv(client, buf, n);
+    auto action = rcv(client, buf, size);
     if (action == ServerAction::Stop) {
       return;
     }
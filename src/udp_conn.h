@@ -10,17 +10,21 @@
 #include <sys/socket.h>
 #include <sys/types.h>
 
+#include <atomic>
 #include <chrono>
+#include <cstdint>
+#include <experimental/optional>
 #include <functional>
 #include <iostream>
 #include <memory>
 #include <string>
 
+#include "link_auth.h"
 #include "log.h"
 #include "net.h"
 #include "net_exception.h"
 
-#define BUFSIZE 1024
+#define BUFSIZE 65536
 
 namespace udp {
 
@@ -29,6 +33,9 @@ typedef int Socket;
 // Creates a new socket with the provided timeout.
 Socket CreateSocket(const std::chrono::microseconds timeout);
 
+// Sets the receive timeout of the socket, or throws an exception on error.
+void SetSocketTimeout(Socket sockfd, const std::chrono::microseconds timeout);
+
 // Determines if the current error was a result of a timeout.
 inline bool IsErrnoTimeout();
 
@@ -64,14 +71,64 @@ typedef std::function<ServerAction()> OnTimeout;
 
 const auto kNoTimeout = std::chrono::microseconds{0};
 
+typedef std::shared_ptr<const LinkAuth> LinkAuthPtr;
+
+// Counts the datagrams a Client exchanged with its remote server.
+struct ClientCounts {
+  uint64_t datagrams_sent;
+  uint64_t bytes_sent;
+  // Replies received while waiting for an acknowledgement, whether valid or
+  // not.
+  uint64_t replies_received;
+  uint64_t reply_bytes_received;
+  // Waits for an acknowledgement that timed out without any reply.
+  uint64_t ack_timeouts;
+};
+
+// Counts the datagrams a Server received.
+struct ServerCounts {
+  uint64_t datagrams_received;
+  uint64_t bytes_received;
+  // Datagrams that failed link authentication.
+  uint64_t inauthentic;
+};
+
 // Provides an interface to send UDP messages to a remote server.
 class Client : public std::enable_shared_from_this<Client> {
  public:
   Client(net::Address addr, std::chrono::microseconds timeout = kNoTimeout)
-      : sockfd_(CreateSocket(timeout)), remote_address_(addr){};
+      : sockfd_(CreateSocket(timeout)),
+        remote_address_(addr),
+        authentic_(true),
+        counts_{} {};
+
+  // Creates a client for the remote server of process peer, whose datagrams
+  // are all authenticated with link_auth.
+  Client(net::Address addr, std::chrono::microseconds timeout,
+         LinkAuthPtr link_auth, unsigned int peer)
+      : sockfd_(CreateSocket(timeout)),
+        remote_address_(addr),
+        link_auth_(link_auth),
+        peer_(peer),
+        authentic_(true),
+        counts_{} {};
 
   Client(struct sockaddr_in sockaddr)
-      : sockfd_(CreateSocket(kNoTimeout)), remote_address_(sockaddr){};
+      : sockfd_(CreateSocket(kNoTimeout)),
+        remote_address_(sockaddr),
+        authentic_(true),
+        counts_{} {};
+
+  // Creates a client for the sender of a datagram received by a server using
+  // link_auth. The datagram is authentic if its sender, peer, is known.
+  Client(struct sockaddr_in sockaddr, LinkAuthPtr link_auth,
+         std::experimental::optional<unsigned int> peer)
+      : sockfd_(CreateSocket(kNoTimeout)),
+        remote_address_(sockaddr),
+        link_auth_(link_auth),
+        peer_(peer),
+        authentic_(bool(peer)),
+        counts_{} {};
 
   ~Client() { close(sockfd_); };
 
@@ -80,8 +137,9 @@ class Client : public std::enable_shared_from_this<Client> {
 
   // Sends the message to the remote server and waits for an acknowledgement.
   // Will send up to the number of attempts provided, unless attempts = 0, in
-  // which case it will continue to send forever until an ack is seen.
-  void SendWithAck(const char* buf, size_t size, unsigned int attempts,
+  // which case it will continue to send forever until an ack is seen. Returns
+  // whether a valid acknowledgement was seen.
+  bool SendWithAck(const char* buf, size_t size, unsigned int attempts,
                    OnReceiveFn validAck) const;
 
   // Returns the address of the remote server.
@@ -93,22 +151,77 @@ class Client : public std::enable_shared_from_this<Client> {
     return remote_address_.Hostname();
   };
 
+  // Returns the process ID of the remote server, if it is known from link
+  // authentication.
+  inline std::experimental::optional<unsigned int> Peer() const {
+    return peer_;
+  };
+  // Returns whether the datagram this client was created for passed link
+  // authentication. Always true without link authentication. Inauthentic
+  // datagrams are still handed to the receive callback, so that a flood of
+  // them can not keep it from checking its deadlines, but must not be decoded.
+  inline bool Authentic() const { return authentic_; };
+
+  // Returns the datagrams exchanged with the remote server so far.
+  ClientCounts Counts() const;
+
  private:
   const Socket sockfd_;
   const SocketAddress remote_address_;
+  const LinkAuthPtr link_auth_;
+  const std::experimental::optional<unsigned int> peer_;
+  const bool authentic_;
+
+  // Updated by every sender thread using the client.
+  mutable struct {
+    std::atomic<uint64_t> datagrams_sent;
+    std::atomic<uint64_t> bytes_sent;
+    std::atomic<uint64_t> replies_received;
+    std::atomic<uint64_t> reply_bytes_received;
+    std::atomic<uint64_t> ack_timeouts;
+  } counts_;
 };
 
 // Listens for incoming UDP messages.
 class Server {
  public:
-  Server(unsigned short port, std::chrono::microseconds timeout = kNoTimeout);
-
-  ~Server() { close(sockfd_); };
+  // Creates a server listening on the port. If link_auth is provided, every
+  // datagram received is authenticated, and its trailer stripped, before it is
+  // handed to the receive callback.
+  Server(unsigned short port, LinkAuthPtr link_auth = nullptr);
+
+  ~Server() {
+    close(sockfd_);
+    close(timerfd_);
+  };
 
+  // Hands every datagram received to the receive callback, until a callback
+  // returns ServerAction::Stop. Once the armed deadline passes, calls the
+  // timeout callback before handling any other datagram, so that no amount of
+  // traffic can delay it.
   void Listen(OnReceiveFn rcv, OnTimeout timeout) const;
 
+  // Arms the deadline at the provided time, replacing any armed before. A
+  // deadline that already passed fires right away. Once fired, the deadline is
+  // disarmed until it is armed again.
+  void SetDeadline(std::chrono::steady_clock::time_point deadline) const;
+
+  // Returns the datagrams received so far.
+  ServerCounts Counts() const;
+
  private:
   const Socket sockfd_;
+  // A CLOCK_MONOTONIC timerfd armed with absolute deadlines, the same clock as
+  // std::chrono::steady_clock.
+  const int timerfd_;
+  const LinkAuthPtr link_auth_;
+
+  // Only updated by Listen, but read from any thread.
+  mutable struct {
+    std::atomic<uint64_t> datagrams_received;
+    std::atomic<uint64_t> bytes_received;
+    std::atomic<uint64_t> inauthentic;
+  } counts_;
 };
 
 }  // namespace udp